@@ -11,6 +11,10 @@
 #define TURN_HEATER_ON              2
 #define TURN_HEATER_OFF             3
 #define MANUAL_HEATER_CONTROL       4   // Expects a transmission value
+#define AUTOMATIC_HEATER_CONTROL    12  // Expects a transmission value
+
+// The AUTOMATIC_HEATER_CONTROL value is the target internal temperature
+// in hundredths of a degree C, as a signed 16 bit number (-1500 is -15 C)
 
 // Attitude control commands
 #define TURN_ATTITUDE_CONTROL_ON    5
@@ -23,6 +27,8 @@
 
 // Relay controls
 #define SWITCH_RELAYS               100 // Expects a transmission value
+#define SCHEDULE_RELAYS             101 // Expects a list of relay steps
+#define CLEAR_RELAY_SCHEDULE        102
 
 // Checks whether radio communication is possible
 // between the ground and the balloon
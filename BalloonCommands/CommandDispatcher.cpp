@@ -0,0 +1,232 @@
+// Written by Andrew Donelick
+// adonelick@hmc.edu
+
+#include "CommandDispatcher.h"
+
+CommandDispatcher::CommandDispatcher(const CommandEntry table[], uint8_t numEntries)
+    : table_(table),
+      numEntries_(numEntries)
+{
+    for (uint8_t i = 0; i < COMMAND_SLOTS; ++i) {
+        index_[i] = COMMAND_NO_ENTRY;
+    }
+
+    resetStatistics();
+}
+
+
+bool CommandDispatcher::begin()
+{
+    if (numEntries_ > COMMAND_MAX_ENTRIES) {
+        return false;
+    }
+
+    for (uint8_t i = 0; i < COMMAND_SLOTS; ++i) {
+        index_[i] = COMMAND_NO_ENTRY;
+    }
+
+    for (uint8_t i = 0; i < numEntries_; ++i)
+    {
+        uint8_t slot = pgm_read_word(&table_[i].command) & (COMMAND_SLOTS - 1);
+        if (index_[slot] != COMMAND_NO_ENTRY) {
+            return false;
+        }
+        index_[slot] = i;
+    }
+
+    return true;
+}
+
+
+uint8_t CommandDispatcher::dispatch(uint16_t command, const uint16_t args[], uint8_t numArgs)
+{
+    uint8_t i = find(command);
+    if (i == COMMAND_NO_ENTRY) {
+        return COMMAND_UNKNOWN;
+    }
+
+    CommandEntry entry;
+    memcpy_P(&entry, &table_[i], sizeof(CommandEntry));
+
+    uint8_t result = check(entry, args, numArgs);
+    if (result != COMMAND_OK) {
+        return result;
+    }
+
+    unsigned long start = micros();
+    result = entry.handler(args, numArgs);
+    unsigned long time = micros() - start;
+
+    if (counts_[i] < 0xFFFF) {
+        ++counts_[i];
+        totalTime_[i] += time;
+    }
+    if (time > maxTime_[i]) {
+        maxTime_[i] = (time > 0xFFFF) ? 0xFFFF : time;
+    }
+
+    return result;
+}
+
+
+uint16_t CommandDispatcher::dispatchBatch(const uint16_t batch[], uint16_t length, 
+                                          uint16_t response[])
+{
+    // Find where each command starts, checking the batch is complete
+    uint16_t starts[COMMAND_MAX_BATCH];
+    uint8_t numCommands = 0;
+    uint16_t position = 1;
+    while (length > 0 && position < length)
+    {
+        if (numCommands >= COMMAND_MAX_BATCH || position + 2 > length ||
+            batch[position + 1] > 0xFF || position + 2 + batch[position + 1] > length)
+        {
+            response[0] = COMMAND_BAD_LENGTH;
+            response[1] = 0;
+            return BATCH_RESPONSE_LENGTH(0);
+        }
+
+        starts[numCommands++] = position;
+        position += 2 + batch[position + 1];
+    }
+
+    bool atomic = length > 0 && (batch[0] & BATCH_ATOMIC);
+    bool run = true;
+    response[0] = COMMAND_OK;
+    response[1] = numCommands;
+
+    // In an atomic batch nothing runs unless every command is valid
+    if (atomic)
+    {
+        for (uint8_t i = 0; i < numCommands; ++i)
+        {
+            const uint16_t* command = batch + starts[i];
+            uint8_t result = validate(command[0], command + 2, command[1]);
+            response[2 + 2 * i] = command[0];
+            response[3 + 2 * i] = result;
+            if (result != COMMAND_OK) {
+                run = false;
+            }
+        }
+
+        if (!run)
+        {
+            for (uint8_t i = 0; i < numCommands; ++i)
+            {
+                if (response[3 + 2 * i] == COMMAND_OK) {
+                    response[3 + 2 * i] = COMMAND_NOT_RUN;
+                }
+            }
+            response[0] = COMMAND_FAILED;
+            return BATCH_RESPONSE_LENGTH(numCommands);
+        }
+    }
+
+    for (uint8_t i = 0; i < numCommands; ++i)
+    {
+        const uint16_t* command = batch + starts[i];
+        uint8_t result = COMMAND_NOT_RUN;
+        if (run) {
+            result = dispatch(command[0], command + 2, command[1]);
+        }
+
+        if (result != COMMAND_OK)
+        {
+            response[0] = COMMAND_FAILED;
+            if (atomic) {
+                run = false;
+            }
+        }
+
+        response[2 + 2 * i] = command[0];
+        response[3 + 2 * i] = result;
+    }
+
+    return BATCH_RESPONSE_LENGTH(numCommands);
+}
+
+
+uint8_t CommandDispatcher::validate(uint16_t command, const uint16_t args[], uint8_t numArgs)
+{
+    uint8_t i = find(command);
+    if (i == COMMAND_NO_ENTRY) {
+        return COMMAND_UNKNOWN;
+    }
+
+    CommandEntry entry;
+    memcpy_P(&entry, &table_[i], sizeof(CommandEntry));
+    return check(entry, args, numArgs);
+}
+
+
+bool CommandDispatcher::handles(uint16_t command)
+{
+    return find(command) != COMMAND_NO_ENTRY;
+}
+
+
+uint16_t CommandDispatcher::getCount(uint16_t command)
+{
+    uint8_t i = find(command);
+    return (i == COMMAND_NO_ENTRY) ? 0 : counts_[i];
+}
+
+
+uint16_t CommandDispatcher::getMaxTime(uint16_t command)
+{
+    uint8_t i = find(command);
+    return (i == COMMAND_NO_ENTRY) ? 0 : maxTime_[i];
+}
+
+
+uint16_t CommandDispatcher::getAverageTime(uint16_t command)
+{
+    uint8_t i = find(command);
+    if (i == COMMAND_NO_ENTRY || counts_[i] == 0) {
+        return 0;
+    }
+    return totalTime_[i] / counts_[i];
+}
+
+
+void CommandDispatcher::resetStatistics()
+{
+    for (uint8_t i = 0; i < COMMAND_MAX_ENTRIES; ++i)
+    {
+        counts_[i] = 0;
+        maxTime_[i] = 0;
+        totalTime_[i] = 0;
+    }
+}
+
+
+uint8_t CommandDispatcher::find(uint16_t command)
+{
+    uint8_t i = index_[command & (COMMAND_SLOTS - 1)];
+    if (i == COMMAND_NO_ENTRY || pgm_read_word(&table_[i].command) != command) {
+        return COMMAND_NO_ENTRY;
+    }
+    return i;
+}
+
+
+uint8_t CommandDispatcher::check(const CommandEntry& entry, const uint16_t args[], uint8_t numArgs)
+{
+    if (numArgs < entry.minArgs || numArgs > entry.maxArgs) {
+        return COMMAND_BAD_LENGTH;
+    }
+
+    for (uint8_t i = 0; i < numArgs; ++i)
+    {
+        long value = args[i];
+        if (entry.flags & COMMAND_SIGNED) {
+            value = (int16_t) args[i];
+        }
+
+        if (value < entry.minValue || value > entry.maxValue) {
+            return COMMAND_OUT_OF_RANGE;
+        }
+    }
+
+    return COMMAND_OK;
+}
@@ -0,0 +1,164 @@
+// Written by Andrew Donelick
+// adonelick@hmc.edu
+
+
+/*
+ * Runs the handler for each command received, from a table in flash
+ * which the sketch writes once instead of a long if/else chain:
+ *
+ *     const CommandEntry commands[] PROGMEM = {
+ *         // command                  args   values       handler       flags
+ *         { CUTDOWN,                  0, 0,  0, 0,        cutdown,      0 },
+ *         { SET_YAW,                  1, 1,  0, 359,      setYaw,       0 },
+ *         { SWITCH_RELAYS,            1, 1,  0, 0x0F,     switchRelays, 0 },
+ *         { AUTOMATIC_HEATER_CONTROL, 1, 1,  -4000, 4000, setTarget,    COMMAND_SIGNED },
+ *     };
+ *     CommandDispatcher dispatcher(commands, 4);
+ *
+ * Before a handler runs the number of arguments, and every argument,
+ * are checked against the limits in its entry. Arguments are unsigned
+ * unless the entry has COMMAND_SIGNED, in which case they are read as
+ * signed 16 bit numbers (the handler casts them to int16_t). Commands are found 
+ * through a small index of COMMAND_SLOTS entries (by the low bits of
+ * the command number), so finding one takes the same time however 
+ * long the table is. The number of times each command has been run, 
+ * and how long its handler took, are kept for telemetry.
+ *
+ * A batch runs several commands from one uplink frame, in order, and
+ * lists all of their results for one COMMAND_RESPONSE frame. A batch
+ * is a flags word followed by each command, its number of arguments,
+ * and its arguments:
+ *
+ *     BATCH_ATOMIC, SET_P_GAIN, 1, p, SET_I_GAIN, 1, i, SET_D_GAIN, 1, d
+ *
+ * The batch must end with its last argument: the checksum word which 
+ * PacketRadio::processData() leaves at the end of the data is not 
+ * part of it.
+ *
+ * Its response is the batch result, the number of commands, then the 
+ * number and result of each command. With BATCH_ATOMIC set every 
+ * command is checked before any runs, and nothing runs unless all 
+ * pass. Commands cannot be undone once they have run, so if a handler
+ * fails the rest of the batch is not run (COMMAND_NOT_RUN).
+ */
+
+
+#ifndef COMMAND_DISPATCHER_H
+#define COMMAND_DISPATCHER_H 1
+
+#include <inttypes.h>
+
+#if ARDUINO >= 100
+#include "Arduino.h"       // for delayMicroseconds, digitalPinToBitMask, etc
+#else
+#include "WProgram.h"      // for delayMicroseconds
+#include "pins_arduino.h"  // for digitalPinToBitMask, etc
+#endif
+
+#include <avr/pgmspace.h>
+#include "BalloonCommands.h"
+
+// Results of a command. Handlers return COMMAND_OK, COMMAND_FAILED, or
+// a code of their own from COMMAND_USER up.
+#define COMMAND_OK 0
+#define COMMAND_FAILED 1
+#define COMMAND_UNKNOWN 2
+#define COMMAND_BAD_LENGTH 3
+#define COMMAND_OUT_OF_RANGE 4
+#define COMMAND_NOT_RUN 5
+#define COMMAND_USER 16
+
+// Entry flags: the arguments are signed
+#define COMMAND_SIGNED 0x01
+
+// Most commands in a table, and the size of the index (a power of two,
+// no two commands in a table may share their low bits)
+#define COMMAND_MAX_ENTRIES 24
+#define COMMAND_SLOTS 64
+#define COMMAND_NO_ENTRY 0xFF
+
+// Most commands in a batch, batch flags, and the words in a batch 
+// response for a number of commands
+#define COMMAND_MAX_BATCH 16
+#define BATCH_ATOMIC 0x0001
+#define BATCH_RESPONSE_LENGTH(n) (2 + 2 * (n))
+
+// Handlers are given the arguments which came with their command
+typedef uint8_t (*CommandHandler)(const uint16_t args[], uint8_t numArgs);
+
+// A command in the table: its number, the fewest and most arguments it
+// takes, the range every argument must be in, its handler, and flags
+struct CommandEntry
+{
+    uint16_t command;
+    uint8_t minArgs;
+    uint8_t maxArgs;
+    long minValue;
+    long maxValue;
+    CommandHandler handler;
+    uint8_t flags;
+};
+
+
+class CommandDispatcher
+{
+    private:
+
+        const CommandEntry* table_;
+        uint8_t numEntries_;
+
+        // Table entry for each slot, by the command's low bits
+        uint8_t index_[COMMAND_SLOTS];
+
+        // Times each command has run, and its handler's longest and 
+        // total time (us)
+        uint16_t counts_[COMMAND_MAX_ENTRIES];
+        uint16_t maxTime_[COMMAND_MAX_ENTRIES];
+        uint32_t totalTime_[COMMAND_MAX_ENTRIES];
+
+    public:
+
+        // The table must be in PROGMEM
+        CommandDispatcher(const CommandEntry table[], uint8_t numEntries);
+
+        // Builds the index. Returns false if the table is too long, or
+        // two of its commands share a slot.
+        bool begin();
+
+        // Checks a command's arguments and runs its handler, returning
+        // the result
+        uint8_t dispatch(uint16_t command, const uint16_t args[], uint8_t numArgs);
+
+        // Runs a batch of commands, and writes its response (which is at
+        // most BATCH_RESPONSE_LENGTH(COMMAND_MAX_BATCH) words). Returns 
+        // the number of words written. The length is that of the batch
+        // alone, without the frame's checksum word.
+        uint16_t dispatchBatch(const uint16_t batch[], uint16_t length, 
+                               uint16_t response[]);
+
+        // Checks a command's arguments without running it
+        uint8_t validate(uint16_t command, const uint16_t args[], uint8_t numArgs);
+
+        // Whether a command is in the table
+        bool handles(uint16_t command);
+
+        // Times a command has run, and its handler's longest and average
+        // time (us)
+        uint16_t getCount(uint16_t command);
+        uint16_t getMaxTime(uint16_t command);
+        uint16_t getAverageTime(uint16_t command);
+
+        // Clears the counts and times
+        void resetStatistics();
+
+    private:
+
+        // Table position of a command, or COMMAND_NO_ENTRY
+        uint8_t find(uint16_t command);
+
+        // Checks the arguments against an entry
+        uint8_t check(const CommandEntry& entry, const uint16_t args[], uint8_t numArgs);
+};
+
+
+#endif // CommandDispatcher included
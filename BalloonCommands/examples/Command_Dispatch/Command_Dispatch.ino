@@ -0,0 +1,96 @@
+// BalloonCommands Example (Command dispatch)
+// Written by Andrew Donelick
+// <adonelick@hmc.edu>
+
+// Receives commands over the radio and runs them through a
+// CommandDispatcher, which checks their arguments first. A
+// COMMAND_BATCH frame runs several commands, and is answered with
+// one COMMAND_RESPONSE frame.
+
+#include <PacketRadio.h>
+#include <BalloonCommands.h>
+#include <CommandDispatcher.h>
+
+#define RTS 2
+#define DSR 3
+
+PacketRadio radio(Serial, DSR, RTS, 10000);
+char packet[MAX_BUFFER_LENGTH];
+uint16_t data[MAX_BUFFER_LENGTH / 2];
+uint16_t response[3 + BATCH_RESPONSE_LENGTH(COMMAND_MAX_BATCH)];
+
+unsigned int yaw = 0;
+int heaterTarget = 0;
+bool cutdownFired = false;
+
+uint8_t cutdown(const uint16_t[], uint8_t)
+{
+  cutdownFired = true;
+  return COMMAND_OK;
+}
+
+uint8_t setYaw(const uint16_t args[], uint8_t)
+{
+  yaw = args[0];
+  return COMMAND_OK;
+}
+
+uint8_t setHeaterTarget(const uint16_t args[], uint8_t)
+{
+  // Hundredths of a degree C, signed
+  heaterTarget = (int16_t) args[0];
+  return COMMAND_OK;
+}
+
+uint8_t checkRadio(const uint16_t[], uint8_t)
+{
+  return COMMAND_OK;
+}
+
+// command, fewest and most arguments, argument range, handler, flags
+const CommandEntry commands[] PROGMEM = {
+  { CUTDOWN,                  0, 0,   0, 0,         cutdown,         0 },
+  { SET_YAW,                  1, 1,   0, 359,       setYaw,          0 },
+  { AUTOMATIC_HEATER_CONTROL, 1, 1,   -4000, 4000,  setHeaterTarget, COMMAND_SIGNED },
+  { CHECK_RADIO_CONNECTION,   0, 0,   0, 0,         checkRadio,      0 }
+};
+
+CommandDispatcher dispatcher(commands, sizeof(commands) / sizeof(CommandEntry));
+
+void setup()
+{
+  Serial.begin(1200);
+  radio.begin();
+  dispatcher.begin();
+}
+
+void loop()
+{
+  uint16_t length;
+  uint16_t dataLength;
+
+  // processData() leaves the checksum as the last word of the data,
+  // so a command frame is at least 4 words
+  if (radio.available() && radio.recieveData(packet, length) &&
+      radio.processData(packet, data, dataLength) && dataLength >= 4)
+  {
+    response[0] = BALLOON;
+    response[1] = COMMAND_RESPONSE;
+
+    if (data[1] == COMMAND)
+    {
+      // data[2] is the command, any arguments follow it (up to the 
+      // checksum)
+      response[2] = data[2];
+      response[3] = dispatcher.dispatch(data[2], data + 3, dataLength - 4);
+      radio.sendData(response, 4);
+    }
+    else if (data[1] == COMMAND_BATCH)
+    {
+      // The batch starts at data[2] and runs up to the checksum
+      response[2] = COMMAND_BATCH;
+      uint16_t responseLength = dispatcher.dispatchBatch(data + 2, dataLength - 3, response + 3);
+      radio.sendData(response, 3 + responseLength);
+    }
+  }
+}
@@ -0,0 +1,130 @@
+// Written by Andrew Donelick
+// adonelick@hmc.edu
+
+#include "BackgroundLogger.h"
+#include <util/atomic.h>
+
+BackgroundLogger::BackgroundLogger(DataFile& dataFile)
+    : dataFile_(dataFile),
+      active_(0),
+      position_(0),
+      dropped_(0),
+      maxFill_(0)
+{
+    lengths_[0] = 0;
+    lengths_[1] = 0;
+}
+
+
+bool BackgroundLogger::append(const void* record, uint8_t length)
+{
+    bool appended = false;
+
+    // The copy is short, so it is done with interrupts off rather than
+    // reserving space first and copying later
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        uint8_t* buffer = buffers_[active_];
+        uint16_t fill = lengths_[active_];
+
+        if (fill + length + 1 <= BACKGROUND_BUFFER_SIZE)
+        {
+            buffer[fill] = length;
+            memcpy(buffer + fill + 1, record, length);
+            fill += length + 1;
+            lengths_[active_] = fill;
+            appended = true;
+
+            if (fill > maxFill_) {
+                maxFill_ = fill;
+            }
+        }
+        else
+        {
+            ++dropped_;
+        }
+    }
+
+    return appended;
+}
+
+
+bool BackgroundLogger::service()
+{
+    uint8_t writing = !active_;
+
+    // When the buffer being written is finished, swap if the other has
+    // records in it
+    if (position_ == lengths_[writing])
+    {
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+        {
+            lengths_[writing] = 0;
+            if (lengths_[active_] > 0)
+            {
+                active_ = writing;
+                writing = !writing;
+            }
+        }
+        position_ = 0;
+    }
+
+    // Only this function changes the buffer which is not active, so it 
+    // can be read with interrupts on
+    uint16_t length = lengths_[writing];
+    uint16_t step = 0;
+    while (position_ < length && step < BACKGROUND_STEP)
+    {
+        uint8_t recordLength = buffers_[writing][position_];
+        dataFile_.writeRecord(buffers_[writing] + position_ + 1, recordLength);
+        position_ += recordLength + 1;
+        step += recordLength + 1;
+    }
+
+    bool waiting;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        waiting = position_ < length || lengths_[active_] > 0;
+    }
+    return waiting;
+}
+
+
+void BackgroundLogger::flush()
+{
+    while (service())
+        ;
+    dataFile_.sync();
+}
+
+
+unsigned int BackgroundLogger::getDropped()
+{
+    unsigned int dropped;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        dropped = dropped_;
+    }
+    return dropped;
+}
+
+
+uint16_t BackgroundLogger::getMaxFill()
+{
+    uint16_t fill;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        fill = maxFill_;
+    }
+    return fill;
+}
+
+
+void BackgroundLogger::resetCounters()
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        dropped_ = 0;
+        maxFill_ = 0;
+    }
+}
@@ -0,0 +1,83 @@
+// Written by Andrew Donelick
+// adonelick@hmc.edu
+
+/*
+ * This class moves SD card writes out of the control loop. Records are
+ * appended to one of two RAM buffers, which is safe to do from an 
+ * interrupt. The other buffer is handed to the DataFile a little at a
+ * time by service(), which should be called when the loop has nothing 
+ * else to do. Once that buffer is empty the two buffers are swapped. If
+ * a record does not fit in the buffer being filled it is dropped and 
+ * counted, so producers never wait on the card.
+ *
+ * Each record is written as one row, so the producer formats it: a line
+ * of text for CSV files, or a binary record (the time, then each column)
+ * for binary and compressed files.
+ */
+
+#ifndef BACKGROUND_LOGGER_H
+#define BACKGROUND_LOGGER_H 1
+
+#if ARDUINO >= 100
+#include "Arduino.h"       // for delayMicroseconds, digitalPinToBitMask, etc
+#else
+#include "WProgram.h"      // for delayMicroseconds
+#include "pins_arduino.h"  // for digitalPinToBitMask, etc
+#endif
+
+#include "DataFile.h"
+
+// Size of each of the two buffers (bytes), including one length byte
+// for every record
+#define BACKGROUND_BUFFER_SIZE 256
+
+// Most bytes handed to the DataFile by one call to service(), which
+// fills at most one SD block. The rows written can also trigger the 
+// DataFile's own work when it is due: writing out the buffer early 
+// (FLUSH_ON_AGE), a journal commit and sync (contiguous files), or a 
+// block of the time index, so a call may occasionally take longer.
+#define BACKGROUND_STEP 64
+
+
+class BackgroundLogger
+{
+    private:
+        DataFile& dataFile_;
+
+        // The two buffers, how much of each is filled, and which one 
+        // records are appended to
+        uint8_t buffers_[2][BACKGROUND_BUFFER_SIZE];
+        volatile uint16_t lengths_[2];
+        volatile uint8_t active_;
+
+        // How much of the other buffer has been written out
+        uint16_t position_;
+
+        // Records dropped because the buffer was full, and the fullest
+        // the buffer being filled has been (bytes)
+        volatile unsigned int dropped_;
+        volatile uint16_t maxFill_;
+
+    public:
+
+        BackgroundLogger(DataFile& dataFile);
+
+        // Adds a record (at most 255 bytes) to be logged. Safe to call
+        // from an interrupt. Returns false if the record was dropped.
+        bool append(const void* record, uint8_t length);
+
+        // Writes up to BACKGROUND_STEP bytes of records to the data file.
+        // Returns true if there are still records waiting.
+        bool service();
+
+        // Writes every waiting record, then syncs the data file
+        void flush();
+
+        // Counters for dropped records and the fullest buffer
+        unsigned int getDropped();
+        uint16_t getMaxFill();
+        void resetCounters();
+};
+
+
+#endif // BACKGROUND_LOGGER_H
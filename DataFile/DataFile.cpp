@@ -6,22 +6,74 @@
 #include "DataFile.h"
 
 DataFile::DataFile()
-    : numEntries_(0),
+    : named_(false),
+      numEntries_(0),
       currentEntry_(0),
-      arduinoType_(UNO)
+      arduinoType_(UNO),
+      format_(FORMAT_CSV),
+      precision_(DATAFILE_PRECISION),
+      bufferLength_(0),
+      blockPosition_(0),
+      partialWritten_(false),
+      flushPolicy_(FLUSH_ON_FULL),
+      maxAge_(DATAFILE_MAX_AGE),
+      bufferTime_(0),
+      unwritten_(false),
+      contiguous_(false),
+      contiguousOpen_(false),
+      contiguousSize_(0),
+      firstBlock_(0),
+      lastBlock_(0),
+      written_(0),
+      rows_(0),
+      commitPeriod_(DATAFILE_COMMIT_PERIOD),
+      commitTime_(0),
+      commitSequence_(0),
+      maxLatency_(0),
+      valueIndex_(0),
+      rowsToIndex_(0),
+      indexing_(false),
+      indexLength_(0)
 {
-    strcpy(filename_, "DATA000.CSV");
+    resetLatency();
+    strcpy(filename_, "DATA0000.CSV");
 }
 
 DataFile::DataFile(int arduinoType)
-    : numEntries_(0),
+    : named_(false),
+      numEntries_(0),
       currentEntry_(0),
-      arduinoType_(arduinoType)
+      arduinoType_(arduinoType),
+      format_(FORMAT_CSV),
+      precision_(DATAFILE_PRECISION),
+      bufferLength_(0),
+      blockPosition_(0),
+      partialWritten_(false),
+      flushPolicy_(FLUSH_ON_FULL),
+      maxAge_(DATAFILE_MAX_AGE),
+      bufferTime_(0),
+      unwritten_(false),
+      contiguous_(false),
+      contiguousOpen_(false),
+      contiguousSize_(0),
+      firstBlock_(0),
+      lastBlock_(0),
+      written_(0),
+      rows_(0),
+      commitPeriod_(DATAFILE_COMMIT_PERIOD),
+      commitTime_(0),
+      commitSequence_(0),
+      maxLatency_(0),
+      valueIndex_(0),
+      rowsToIndex_(0),
+      indexing_(false),
+      indexLength_(0)
 {
-    strcpy(filename_, "DATA000.CSV");
+    resetLatency();
+    strcpy(filename_, "DATA0000.CSV");
 }
 
-void DataFile::begin()
+bool DataFile::begin()
 {
     // Start the SD card
     // These pins need to be set to output for writing to the
@@ -36,46 +88,338 @@ void DataFile::begin()
         SD.begin(10);
     }
 
-    int i = 1;
-    while (SD.exists(filename_) && (i < 999))
+    if (format_ == FORMAT_BINARY) {
+        strcpy(filename_ + 9, "BIN");
+    } else if (format_ == FORMAT_COMPRESSED) {
+        strcpy(filename_ + 9, "CMP");
+    }
+
+    // Files are numbered from zero, one per run, so every number below
+    // the first unused one is taken. A binary search finds it with 
+    // about 14 directory scans instead of one for every file on the card.
+    // (If files have been deleted from the middle, a gap may be reused,
+    // but an existing file is never picked while there is a free number.)
+    unsigned int used = 0;
+    unsigned int unused = DATAFILE_MAX_FILES;
+    if (!fileExists(0)) {
+        unused = 0;
+    }
+
+    while (unused - used > 1)
     {
-        filename_[4] = i/100 + '0';
-        filename_[5] = (i%100)/10 + '0';
-        filename_[6] = (i%100)%10 + '0';
-        ++i;
+        unsigned int middle = used + (unused - used)/2;
+        if (fileExists(middle)) {
+            used = middle;
+        } else {
+            unused = middle;
+        }
+    }
+
+    // With every number taken there is nowhere to log: adding to the
+    // last file would break its header (or its journal)
+    named_ = (unused < DATAFILE_MAX_FILES);
+    if (!named_) {
+        return false;
+    }
+    setFileNumber(unused);
+
+    if (contiguous_) {
+        contiguous_ = beginContiguous((arduinoType_ == MEGA) ? 53 : 10, unused);
+    }
+    return true;
+}
+
+bool DataFile::beginContiguous(uint8_t chipSelect, unsigned int number)
+{
+    SdFile root;
+    if (!card_.init(SPI_FULL_SPEED, chipSelect) || !volume_.init(&card_) ||
+        !root.openRoot(&volume_))
+        return false;
+
+    // Only the log from the last run can have been left unfinished
+    if (number > 0)
+    {
+        setFileNumber(number - 1);
+        recover(root);
+        setFileNumber(number);
+    }
+
+    SdFile file;
+    if (!file.createContiguous(&root, filename_, contiguousSize_))
+        return false;
+    file.contiguousRange(&firstBlock_, &lastBlock_);
+    file.close();
+
+    // Erasing now saves the card from erasing blocks while logging
+    card_.erase(firstBlock_, lastBlock_);
+
+    char journalName[FILENAME_LENGTH];
+    strcpy(journalName, filename_);
+    strcpy(journalName + 9, "JNL");
+    if (!journal_.createContiguous(&root, journalName, DATAFILE_JOURNAL_SIZE))
+    {
+        SdFile::remove(&root, filename_);
+        return false;
+    }
+
+    commit();
+    return true;
+}
+
+// Cuts the file named in filename_ back to the last commit in its 
+// journal, then removes the journal
+void DataFile::recover(SdFile& root)
+{
+    char journalName[FILENAME_LENGTH];
+    strcpy(journalName, filename_);
+    strcpy(journalName + 9, "JNL");
+
+    SdFile journal;
+    if (!journal.open(&root, journalName, O_READ))
+        return;
+
+    DataCommit last;
+    last.magic = 0;
+    for (uint8_t i = 0; i < 2; ++i)
+    {
+        DataCommit record;
+        journal.seekSet(i * DATAFILE_BLOCK_SIZE);
+        if (journal.read(&record, sizeof(record)) == sizeof(record) &&
+            record.magic == DATAFILE_COMMIT_MAGIC &&
+            record.check == (record.magic ^ record.sequence ^ record.length ^ record.rows) &&
+            (last.magic == 0 || record.sequence > last.sequence)) {
+            last = record;
+        }
+    }
+    journal.close();
+
+    SdFile file;
+    if (last.magic == DATAFILE_COMMIT_MAGIC && file.open(&root, filename_, O_WRITE))
+    {
+        if (last.length < file.fileSize()) {
+            file.truncate(last.length);
+        }
+        file.close();
+    }
+
+    SdFile::remove(&root, journalName);
+}
+
+// Saves how much data has been written to the card, alternating between
+// the journal's two blocks so a write cut short leaves the last commit
+void DataFile::commit()
+{
+    DataCommit record;
+    record.magic = DATAFILE_COMMIT_MAGIC;
+    record.sequence = ++commitSequence_;
+    record.length = written_;
+    record.rows = rows_;
+    record.check = record.magic ^ record.sequence ^ record.length ^ record.rows;
+
+    unsigned long start = micros();
+    journal_.seekSet((commitSequence_ & 1) * DATAFILE_BLOCK_SIZE);
+    journal_.write(&record, sizeof(record));
+    journal_.sync();
+    recordLatency(micros() - start);
+
+    commitTime_ = millis();
+}
+
+// The index file is named after the number only, so with indexing on a
+// number whose index is left by a log of another format is also taken
+bool DataFile::fileExists(unsigned int number)
+{
+    setFileNumber(number);
+    if (SD.exists(filename_))
+        return true;
+
+    if (!indexing_)
+        return false;
+
+    char indexName[FILENAME_LENGTH];
+    strcpy(indexName, filename_);
+    strcpy(indexName + 9, "IDX");
+    return SD.exists(indexName);
+}
+
+void DataFile::setFileNumber(unsigned int number)
+{
+    for (int i = 7; i >= 4; --i)
+    {
+        filename_[i] = number%10 + '0';
+        number /= 10;
     }
 }
 
 void DataFile::open()
 {
-    dataFile_ = SD.open(filename_, FILE_WRITE);
+    if (!named_) {
+        return;
+    }
+
+    if (contiguous_) {
+        contiguousOpen_ = true;
+    } else {
+        dataFile_ = SD.open(filename_, FILE_WRITE);
+    }
+
+    if (indexing_)
+    {
+        char indexName[FILENAME_LENGTH];
+        strcpy(indexName, filename_);
+        strcpy(indexName + 9, "IDX");
+        indexFile_ = SD.open(indexName, FILE_WRITE);
+
+        // The index header: "SPKI", version, the index interval, and two
+        // spare bytes
+        if (indexFile_ && indexFile_.size() == 0)
+        {
+            uint8_t header[8] = {0, 0, 0, 0, INDEX_VERSION, DATAFILE_INDEX_INTERVAL, 0, 0};
+            memcpy(header, INDEX_MAGIC, 4);
+            indexFile_.write(header, 8);
+        }
+    }
 }
 
 void DataFile::close()
 {
-    dataFile_.close();
+    writeBuffer();
+    if (indexFile_)
+    {
+        writeIndex();
+        indexFile_.close();
+    }
+
+    if (contiguous_)
+    {
+        if (contiguousOpen_) {
+            commit();
+        }
+        contiguousOpen_ = false;
+    }
+    else
+    {
+        dataFile_.close();
+    }
+}
+
+void DataFile::sync()
+{
+    writeBuffer();
+    if (contiguous_ && contiguousOpen_)
+    {
+        commit();
+    }
+    else if (dataFile_)
+    {
+        dataFile_.flush();
+    }
+
+    if (indexFile_)
+    {
+        writeIndex();
+        indexFile_.flush();
+    }
 }
 
-void DataFile::addEntry(char const* entryName)
+bool DataFile::isOpen()
+{
+    if (contiguous_) {
+        return contiguousOpen_;
+    }
+    return dataFile_;
+}
+
+void DataFile::setIndexing(bool indexing)
+{
+    indexing_ = indexing;
+}
+
+void DataFile::setContiguous(unsigned long size, unsigned long commitPeriod)
+{
+    contiguous_ = true;
+    contiguousSize_ = size;
+    commitPeriod_ = commitPeriod;
+}
+
+unsigned int DataFile::getLatencyCount(uint8_t bin)
+{
+    if (bin >= DATAFILE_LATENCY_BINS)
+        return 0;
+    return latency_[bin];
+}
+
+unsigned long DataFile::getMaxLatency()
+{
+    return maxLatency_;
+}
+
+void DataFile::resetLatency()
+{
+    for (uint8_t i = 0; i < DATAFILE_LATENCY_BINS; ++i)
+    {
+        latency_[i] = 0;
+    }
+    maxLatency_ = 0;
+}
+
+// Bins are counted in units of 1024 us, which is close enough to 1 ms
+void DataFile::recordLatency(unsigned long time)
+{
+    unsigned long units = time >> 10;
+    uint8_t bin = 0;
+    while (units > 0 && bin < DATAFILE_LATENCY_BINS - 1)
+    {
+        units >>= 1;
+        ++bin;
+    }
+
+    if (latency_[bin] < 0xFFFF) {
+        ++latency_[bin];
+    }
+    if (time > maxLatency_) {
+        maxLatency_ = time;
+    }
+}
+
+void DataFile::setFlushPolicy(uint8_t policy, unsigned long maxAge)
+{
+    flushPolicy_ = policy;
+    maxAge_ = maxAge;
+}
+
+void DataFile::setPrecision(uint8_t precision)
+{
+    precision_ = precision;
+}
+
+void DataFile::setFormat(uint8_t format)
+{
+    format_ = format;
+}
+
+void DataFile::addEntry(char const* entryName, uint8_t type)
 {
     entries_[numEntries_] = entryName;
+    types_[numEntries_] = type;
     ++numEntries_;
 }
 
 void DataFile::writeFileHeader()
 {
     open();
-    if (dataFile_)
+    if (isOpen() && format_ != FORMAT_CSV)
+    {
+        writeBinaryHeader();
+        close();
+    }
+    else if (isOpen())
     {
+        print("Time");
         for (int i = 0; i < numEntries_; ++i)
         {
-            dataFile_.print("Time,");
-            dataFile_.print(entries_[i]);
-
-            if (i != numEntries_ - 1)
-            {
-                dataFile_.print(',');
-            }
+            print(',');
+            print(entries_[i]);
         }
 
         writeNewLine();
@@ -85,88 +429,198 @@ void DataFile::writeFileHeader()
 
 void DataFile::writeEntry(int value)
 {
-    if (!dataFile_)
+    if (!isOpen())
         return;
+    if (format_ != FORMAT_CSV)
+    {
+        writeBinaryEntry((long) value);
+        return;
+    }
     writeEntryTime();
-    dataFile_.print(value);
+    writeText(value);
     writeEntryEnd();
 }
 
 void DataFile::writeEntry(unsigned int value)
 {
-    if (!dataFile_)
+    if (!isOpen())
         return;
+    if (format_ != FORMAT_CSV)
+    {
+        writeBinaryEntry((unsigned long) value);
+        return;
+    }
     writeEntryTime();
-    dataFile_.print(value);
+    writeText(value);
     writeEntryEnd();
 }
 
 void DataFile::writeEntry(unsigned long value)
 {
-    if (!dataFile_)
+    if (!isOpen())
         return;
+    if (format_ != FORMAT_CSV)
+    {
+        writeBinaryEntry(value);
+        return;
+    }
     writeEntryTime();
-    dataFile_.print(value);
+    writeText(value);
     writeEntryEnd();
 }
 
 void DataFile::writeEntry(float value)
 {
-    if (!dataFile_)
+    if (!isOpen())
+        return;
+    if (format_ != FORMAT_CSV)
+    {
+        writeBinaryEntry(value);
         return;
+    }
     writeEntryTime();
-    dataFile_.print(value);
+    writeText(value);
     writeEntryEnd();
 }
 
 
 void DataFile::writeEntry(bool value)
 {
-    if (!dataFile_)
+    if (!isOpen())
+        return;
+    if (format_ != FORMAT_CSV)
+    {
+        writeBinaryEntry((long) value);
         return;
+    }
 
     writeEntryTime();
     if (value) {
-        dataFile_.print("True");
+        print("True");
     } else {
-        dataFile_.print("False");
+        print("False");
     }
     writeEntryEnd();
 }
 
 void DataFile::writeEntry(char const* value)
 {
-    if (!dataFile_)
+    if (!isOpen())
+        return;
+    if (format_ != FORMAT_CSV)
+    {
+        // Text has no fixed width, so it is logged as a zero
+        writeBinaryEntry(0L);
         return;
+    }
     writeEntryTime();
-    dataFile_.print(value);
+    print(value);
     writeEntryEnd();
 }
 
 
+// Records for binary and compressed files are binary records, which
+// are compressed here for compressed files
+bool DataFile::writeRecord(const uint8_t* data, uint8_t length)
+{
+    if (!isOpen())
+        return false;
+
+    if (format_ == FORMAT_CSV)
+    {
+        // The row's time is the number it starts with
+        uint32_t time = 0;
+        for (uint8_t i = 0; i < length && data[i] >= '0' && data[i] <= '9'; ++i)
+        {
+            time = 10*time + (data[i] - '0');
+        }
+        startRow(time);
+        print((char const*) data, length);
+        endRow();
+        return true;
+    }
+
+    // A record of the wrong length would leave the reader out of step 
+    // with the columns for the rest of the file
+    uint16_t expected = 4;
+    for (int i = 0; i < numEntries_; ++i) {
+        expected += typeSize(types_[i]);
+    }
+    if (length != expected)
+        return false;
+
+    uint32_t time = readBinary(data, 4);
+    if (format_ == FORMAT_BINARY)
+    {
+        startRow(time);
+        print((char const*) data, length);
+    }
+    else
+    {
+        startBinaryRow(time);
+        uint8_t position = 4;
+        for (int i = 0; i < numEntries_; ++i)
+        {
+            uint8_t size = typeSize(types_[i]);
+            uint32_t value = readBinary(data + position, size);
+            if (types_[i] == DATA_INT) {
+                value = (int16_t) value;
+            }
+            writeValue(value, size);
+            position += size;
+        }
+    }
+
+    endRow();
+    return true;
+}
+
+
+// Each row has a single time, before its first entry
 void DataFile::writeEntryTime()
 {
-    if (!dataFile_)
+    if (!isOpen() || currentEntry_ != 0)
         return;
 
-    dataFile_.print(millis());
-    dataFile_.print(',');
+    unsigned long time = millis();
+    startRow(time);
+    writeText(time);
+    print(',');
 }
 
 
 void DataFile::writeEntryEnd()
 {
     
-    if (!dataFile_)
+    if (!isOpen())
         return;
 
     ++currentEntry_;
 
     if (currentEntry_ != numEntries_) {
-        dataFile_.print(',');
+        print(',');
     } else {
         currentEntry_ = 0;
         writeNewLine();
+        endRow();
+    }
+}
+
+
+void DataFile::endRow()
+{
+    ++rows_;
+
+    // Write out data which has waited too long at the end of a row
+    if (flushPolicy_ == FLUSH_ON_AGE && unwritten_ &&
+        millis() - bufferTime_ >= maxAge_) {
+        writeBuffer();
+    }
+
+    if (contiguous_ && millis() - commitTime_ >= commitPeriod_)
+    {
+        writeBuffer();
+        commit();
     }
 }
 
@@ -174,15 +628,402 @@ void DataFile::writeEntryEnd()
 // This function assumes that the ile is open
 void DataFile::writeNewLine()
 {
-    if (dataFile_)
+    if (isOpen())
+    {
+        print("\r\n");
+    }
+}
+
+
+// The binary header describes the records which follow it:
+//   "SPKL", format version, number of columns, record size (2 bytes),
+//   then for each column its type, name length and name.
+// Each record is the time (4 bytes) followed by every column, with all
+// values little endian.
+//
+// Compressed files start with "SPKZ" and the same header, followed by
+// the keyframe interval (1 byte). Each value in a row (the time, then 
+// every column) is stored as the difference from the same value in the
+// previous row, as 32 bit integers (floats by their bit patterns). The 
+// difference is zigzag coded (0, -1, 1, -2, ... become 0, 1, 2, 3, ...)
+// and written 7 bits per byte, low bits first, with the top bit set on
+// every byte but the last. Keyframe rows (the first row, then every 
+// COMPRESSED_KEYFRAME rows) store differences from zero, so decoding 
+// can start at any keyframe.
+void DataFile::writeBinaryHeader()
+{
+    uint16_t recordSize = 4;
+    for (int i = 0; i < numEntries_; ++i)
     {
-        dataFile_.println();
+        recordSize += typeSize(types_[i]);
+    }
+
+    if (format_ == FORMAT_COMPRESSED) {
+        print(COMPRESSED_MAGIC);
+    } else {
+        print(BINARY_MAGIC);
+    }
+    print((char) BINARY_VERSION);
+    print((char) numEntries_);
+    writeBinary(recordSize, 2);
+
+    for (int i = 0; i < numEntries_; ++i)
+    {
+        print((char) types_[i]);
+        print((char) strlen(entries_[i]));
+        print(entries_[i]);
+    }
+
+    if (format_ == FORMAT_COMPRESSED) {
+        print((char) COMPRESSED_KEYFRAME);
+    }
+}
+
+
+void DataFile::writeBinaryEntry(long value)
+{
+    writeBinaryColumn(value, (float) value);
+}
+
+
+void DataFile::writeBinaryEntry(unsigned long value)
+{
+    writeBinaryColumn(value, (float) value);
+}
+
+
+void DataFile::writeBinaryEntry(float value)
+{
+    writeBinaryColumn((long) value, value);
+}
+
+
+// Writes whichever form of the value suits the type of the current
+// column (after the row's time, for the first column of a row)
+void DataFile::writeBinaryColumn(uint32_t integer, float real)
+{
+    if (currentEntry_ == 0) {
+        startBinaryRow(millis());
+    }
+
+    uint8_t type = types_[currentEntry_];
+    if (type == DATA_FLOAT) {
+        union {
+            float asFloat;
+            uint32_t asLong;
+        } converter;
+        converter.asFloat = real;
+        writeValue(converter.asLong, 4);
+    } else {
+        writeValue(integer, typeSize(type));
+    }
+
+    ++currentEntry_;
+    if (currentEntry_ == numEntries_) {
+        currentEntry_ = 0;
+        endRow();
+    }
+}
+
+
+void DataFile::writeText(bool value)
+{
+    print(value ? "True" : "False");
+}
+
+
+void DataFile::writeText(int value)
+{
+    char text[FORMAT_BUFFER_SIZE];
+    print(text, formatLong(text, value));
+}
+
+
+void DataFile::writeText(unsigned int value)
+{
+    char text[FORMAT_BUFFER_SIZE];
+    print(text, formatUnsigned(text, value));
+}
+
+
+void DataFile::writeText(long value)
+{
+    char text[FORMAT_BUFFER_SIZE];
+    print(text, formatLong(text, value));
+}
+
+
+void DataFile::writeText(unsigned long value)
+{
+    char text[FORMAT_BUFFER_SIZE];
+    print(text, formatUnsigned(text, value));
+}
+
+
+void DataFile::writeText(double value)
+{
+    char text[FORMAT_BUFFER_SIZE];
+    print(text, formatFloat(text, value, precision_));
+}
+
+
+void DataFile::writeText(char const* value)
+{
+    print(value);
+}
+
+
+void DataFile::writeBinaryField(bool value)
+{
+    writeValue(value, 1);
+}
+
+
+void DataFile::writeBinaryField(int value)
+{
+    writeValue(value, 2);
+}
+
+
+void DataFile::writeBinaryField(unsigned int value)
+{
+    writeValue(value, 2);
+}
+
+
+void DataFile::writeBinaryField(long value)
+{
+    writeValue(value, 4);
+}
+
+
+void DataFile::writeBinaryField(unsigned long value)
+{
+    writeValue(value, 4);
+}
+
+
+void DataFile::writeBinaryField(double value)
+{
+    union {
+        float asFloat;
+        uint32_t asLong;
+    } converter;
+    converter.asFloat = value;
+    writeValue(converter.asLong, 4);
+}
+
+
+void DataFile::writeBinaryField(char const*)
+{
+    // Text has no fixed width, so it is logged as a zero
+    writeValue(0, 4);
+}
+
+
+void DataFile::startRow(uint32_t time)
+{
+    if (rowsToIndex_ == 0)
+    {
+        // Keyframes are coded against zero
+        memset(previous_, 0, sizeof(previous_));
+        rowsToIndex_ = DATAFILE_INDEX_INTERVAL;
+
+        if (indexing_)
+        {
+            indexBuffer_[indexLength_][0] = time;
+            indexBuffer_[indexLength_][1] = blockPosition_ + bufferLength_;
+            ++indexLength_;
+            if (indexLength_ == DATAFILE_INDEX_BUFFER) {
+                writeIndex();
+            }
+        }
+    }
+    --rowsToIndex_;
+}
+
+
+// Entries are written as they are in memory, which is little endian
+void DataFile::writeIndex()
+{
+    if (indexFile_ && indexLength_ > 0) {
+        indexFile_.write((const uint8_t*) indexBuffer_, indexLength_ * 8);
+    }
+    indexLength_ = 0;
+}
+
+
+void DataFile::startBinaryRow(uint32_t time)
+{
+    startRow(time);
+    valueIndex_ = 0;
+    writeValue(time, 4);
+}
+
+
+void DataFile::writeValue(uint32_t value, uint8_t size)
+{
+    if (format_ != FORMAT_COMPRESSED)
+    {
+        writeBinary(value, size);
+        return;
+    }
+
+    int32_t difference = value - previous_[valueIndex_];
+    previous_[valueIndex_] = value;
+    ++valueIndex_;
+
+    uint32_t zigzag = ((uint32_t) difference << 1) ^ (uint32_t) (difference >> 31);
+    while (zigzag >= 0x80)
+    {
+        print((char) (zigzag | 0x80));
+        zigzag >>= 7;
+    }
+    print((char) zigzag);
+}
+
+
+void DataFile::writeBinary(uint32_t value, uint8_t size)
+{
+    for (uint8_t i = 0; i < size; ++i)
+    {
+        print((char) (value & 0xFF));
+        value >>= 8;
+    }
+}
+
+
+uint32_t DataFile::readBinary(const uint8_t* data, uint8_t size)
+{
+    uint32_t value = 0;
+    for (uint8_t i = size; i > 0; --i)
+    {
+        value = (value << 8) | data[i - 1];
+    }
+    return value;
+}
+
+
+uint8_t DataFile::typeSize(uint8_t type)
+{
+    switch (type)
+    {
+        case DATA_BOOL:
+            return 1;
+        case DATA_INT:
+        case DATA_UINT:
+            return 2;
+        default:
+            return 4;
+    }
+}
+
+
+void DataFile::print(char const* text)
+{
+    while (*text)
+    {
+        print(*text);
+        ++text;
+    }
+}
+
+
+// Copies text into the buffer a block at a time
+void DataFile::print(char const* text, uint8_t length)
+{
+    while (length > 0 && bufferLength_ < DATAFILE_BLOCK_SIZE)
+    {
+        if (!unwritten_)
+        {
+            unwritten_ = true;
+            bufferTime_ = millis();
+        }
+
+        uint16_t space = DATAFILE_BLOCK_SIZE - bufferLength_;
+        uint8_t count = (length < space) ? length : space;
+        memcpy(buffer_ + bufferLength_, text, count);
+        bufferLength_ += count;
+        text += count;
+        length -= count;
+
+        if (bufferLength_ == DATAFILE_BLOCK_SIZE)
+        {
+            writeBuffer();
+        }
+    }
+}
+
+
+void DataFile::print(char c)
+{
+    // A full block which could not be written has nowhere to go
+    if (bufferLength_ == DATAFILE_BLOCK_SIZE)
+        return;
+
+    if (!unwritten_)
+    {
+        unwritten_ = true;
+        bufferTime_ = millis();
+    }
+
+    buffer_[bufferLength_] = c;
+    ++bufferLength_;
+
+    if (bufferLength_ == DATAFILE_BLOCK_SIZE)
+    {
+        writeBuffer();
+    }
+}
+
+
+void DataFile::writeBuffer()
+{
+    if (!isOpen() || bufferLength_ == 0)
+        return;
+
+    unsigned long start = micros();
+    if (contiguous_)
+    {
+        // Past the end of the file there is nowhere to write
+        uint32_t block = firstBlock_ + blockPosition_/DATAFILE_BLOCK_SIZE;
+        if (block > lastBlock_)
+            return;
+
+        // The whole block is always written, so clear the unused part
+        memset(buffer_ + bufferLength_, 0, DATAFILE_BLOCK_SIZE - bufferLength_);
+        if (!card_.writeBlock(block, (const uint8_t*) buffer_))
+            return;
+    }
+    else
+    {
+        // FILE_WRITE appends every write to the end of the file, so if 
+        // part of this block was written before only the rest is written
+        unsigned int done = 0;
+        if (partialWritten_)
+        {
+            done = written_ - blockPosition_;
+        }
+
+        dataFile_.write((const uint8_t*) buffer_ + done, bufferLength_ - done);
+    }
+    recordLatency(micros() - start);
+
+    written_ = blockPosition_ + bufferLength_;
+    unwritten_ = false;
+
+    if (bufferLength_ == DATAFILE_BLOCK_SIZE) {
+        blockPosition_ += DATAFILE_BLOCK_SIZE;
+        bufferLength_ = 0;
+        partialWritten_ = false;
+    } else {
+        partialWritten_ = true;
     }
 }
 
 bool DataFile::checkStatus()
 {
-    if (dataFile_) {
+    if (isOpen()) {
         return true;
     } else {
         return false;
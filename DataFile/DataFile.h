@@ -7,12 +7,30 @@
  * data collected from the balloon. Functionality includes constructing 
  * and writing a file header, automatically generating file names for 
  * the files, and an easy interface for logging individual entries.
+ *
+ * Entries are formatted into a 512 byte buffer which lines up with the
+ * SD card's blocks, and the buffer is written out a whole block at a 
+ * time. When the buffer has to be written before it is full (sync(), 
+ * close(), or because of the flush policy) the partial block is written
+ * but kept, and the whole block is written again once it fills, so the
+ * file's blocks always stay aligned with the card's.
+ *
+ * In contiguous mode (setContiguous()) the whole file is allocated and
+ * erased by begin(), and blocks are written straight to the card, so 
+ * FAT never has to find a new cluster in flight. Every commit period 
+ * the length of the data written so far and the number of rows are 
+ * saved to a small journal file (DATAnnnn.JNL). The file keeps its 
+ * allocated size until the next begin(), which cuts the previous log
+ * back to its last commit, so a log cut short by a brownout is kept up
+ * to that commit. The time taken by every block write is kept in a 
+ * histogram, in either mode.
  */
 
 #ifndef DATAFILE_H
 #define DATAFILE_H 1
 
 #include "SD.h"
+#include "NumberFormat.h"
 
 #if ARDUINO >= 100
 #include "Arduino.h"       // for delayMicroseconds, digitalPinToBitMask, etc
@@ -26,7 +44,109 @@
 #define MEGA 1
 
 #define NUM_ENTRIES 20
-#define FILENAME_LENGTH 12
+#define FILENAME_LENGTH 13
+
+// Files are named DATA0000.CSV up to DATA9999.CSV
+#define DATAFILE_MAX_FILES 10000
+
+// File formats: comma separated text, fixed size binary records after
+// a header which describes them, or binary records compressed as the
+// differences from the previous row
+#define FORMAT_CSV 0
+#define FORMAT_BINARY 1
+#define FORMAT_COMPRESSED 2
+
+// Column types, which set how entries are stored in binary files
+// (their sizes in bytes are in brackets)
+#define DATA_BOOL 1    // bool (1)
+#define DATA_INT 2     // int (2)
+#define DATA_UINT 3    // unsigned int (2)
+#define DATA_LONG 4    // long (4)
+#define DATA_ULONG 5   // unsigned long (4)
+#define DATA_FLOAT 6   // float (4)
+
+// Start of every binary file, and the version of the binary format
+#define BINARY_MAGIC "SPKL"
+#define BINARY_VERSION 1
+
+// Time index: every DATAFILE_INDEX_INTERVAL rows, the row's time and
+// its position in the data file are added to DATAnnnn.IDX. Entries are
+// kept in RAM until DATAFILE_INDEX_BUFFER of them are waiting.
+#define DATAFILE_INDEX_INTERVAL 64
+#define DATAFILE_INDEX_BUFFER 8
+#define INDEX_MAGIC "SPKI"
+#define INDEX_VERSION 1
+
+// Start of every compressed file, and the number of rows from one 
+// keyframe (a row which does not depend on the rows before it) to the
+// next. The keyframes are the rows in the time index.
+#define COMPRESSED_MAGIC "SPKZ"
+#define COMPRESSED_KEYFRAME DATAFILE_INDEX_INTERVAL
+
+// Default number of decimal places for floats in CSV files
+#define DATAFILE_PRECISION 2
+
+// Size of the write buffer (one SD card block)
+#define DATAFILE_BLOCK_SIZE 512
+
+// When the buffer is written to the card: only when it is full, or
+// also once the oldest data in it has waited for the maximum age
+#define FLUSH_ON_FULL 0
+#define FLUSH_ON_AGE 1
+
+// Default maximum age of buffered data (ms) for FLUSH_ON_AGE
+#define DATAFILE_MAX_AGE 1000
+
+// Default time between journal commits (ms) in contiguous mode
+#define DATAFILE_COMMIT_PERIOD 1000
+
+// Marks a valid commit record, and the journal's size (two blocks, 
+// with a commit record at the start of each, used in turn)
+#define DATAFILE_COMMIT_MAGIC 0x4C4E524AUL
+#define DATAFILE_JOURNAL_SIZE 1024
+
+// Block write latency histogram: bin 0 counts writes under 1 ms, and
+// each later bin twice the time of the one before (1-2 ms, 2-4 ms, ...),
+// with the last bin counting everything from 64 ms up
+#define DATAFILE_LATENCY_BINS 8
+
+// Commit record saved in the journal. The check is the other four 
+// fields xored together, so a half written record is not used.
+struct DataCommit
+{
+    uint32_t magic;
+    uint32_t sequence;
+    uint32_t length;
+    uint32_t rows;
+    uint32_t check;
+};
+
+// The types of the columns in a row, for addEntries() and writeRow(), 
+// which are checked when the sketch is compiled. For example:
+//
+//     typedef DataSchema<float, long, bool> BalloonRow;
+//     dataFile.addEntries(BalloonRow(), "Temperature", "Altitude", "Heater");
+//     dataFile.writeRow(BalloonRow(), temperature, altitude, heaterOn);
+template <typename... Types>
+struct DataSchema {};
+
+// Binary column type for each type which can be logged (there is no
+// DataType for any other type, so using one will not compile). Text
+// has no fixed width, and is stored as a zero in binary files.
+template <typename T> struct DataType;
+template <> struct DataType<bool> { static const uint8_t value = DATA_BOOL; };
+template <> struct DataType<int> { static const uint8_t value = DATA_INT; };
+template <> struct DataType<unsigned int> { static const uint8_t value = DATA_UINT; };
+template <> struct DataType<long> { static const uint8_t value = DATA_LONG; };
+template <> struct DataType<unsigned long> { static const uint8_t value = DATA_ULONG; };
+template <> struct DataType<float> { static const uint8_t value = DATA_FLOAT; };
+template <> struct DataType<double> { static const uint8_t value = DATA_FLOAT; };
+template <> struct DataType<char const*> { static const uint8_t value = DATA_LONG; };
+template <> struct DataType<char*> { static const uint8_t value = DATA_LONG; };
+
+// Whether two types are the same (the AVR compiler has no <type_traits>)
+template <typename A, typename B> struct DataSameType { static const bool value = false; };
+template <typename A> struct DataSameType<A, A> { static const bool value = true; };
 
 class DataFile
 {
@@ -34,10 +154,67 @@ class DataFile
     private:
         File dataFile_;
         char filename_[FILENAME_LENGTH];
+
+        // Whether begin() found an unused file name
+        bool named_;
         char const* entries_[NUM_ENTRIES];
+        uint8_t types_[NUM_ENTRIES];
         int numEntries_;
         int currentEntry_;
         int arduinoType_;
+        uint8_t format_;
+        uint8_t precision_;
+
+        // Block being filled, how much of it is filled, its position in
+        // the file, and whether part of it has already been written out
+        char buffer_[DATAFILE_BLOCK_SIZE];
+        uint16_t bufferLength_;
+        unsigned long blockPosition_;
+        bool partialWritten_;
+
+        // Flush policy, and when the oldest data which has not been 
+        // written to the card was added (if there is any)
+        uint8_t flushPolicy_;
+        unsigned long maxAge_;
+        unsigned long bufferTime_;
+        bool unwritten_;
+
+        // Contiguous mode: the card, the blocks of the file, whether it
+        // is open, and the journal
+        bool contiguous_;
+        bool contiguousOpen_;
+        unsigned long contiguousSize_;
+        Sd2Card card_;
+        SdVolume volume_;
+        SdFile journal_;
+        uint32_t firstBlock_;
+        uint32_t lastBlock_;
+
+        // Data written to the card so far, rows finished, and the last
+        // commit to the journal
+        unsigned long written_;
+        unsigned long rows_;
+        unsigned long commitPeriod_;
+        unsigned long commitTime_;
+        uint32_t commitSequence_;
+
+        // Block write latencies
+        unsigned int latency_[DATAFILE_LATENCY_BINS];
+        unsigned long maxLatency_;
+
+        // Compressed files: each value of the previous row (the time 
+        // first), and the value being written
+        uint32_t previous_[NUM_ENTRIES + 1];
+        uint8_t valueIndex_;
+
+        // Time index: rows until the next indexed row (which is also a
+        // keyframe), the index file, and the entries (time, position)
+        // not yet written to it
+        uint8_t rowsToIndex_;
+        bool indexing_;
+        File indexFile_;
+        uint32_t indexBuffer_[DATAFILE_INDEX_BUFFER][2];
+        uint8_t indexLength_;
 
     public:
 
@@ -45,18 +222,53 @@ class DataFile
         DataFile();
         DataFile(int arduinoType);
 
-        // Creates the filename, sets up the SD card communication
-        void begin();
+        // Creates the filename, sets up the SD card communication.
+        // Returns false if every file name is taken, in which case
+        // nothing is logged.
+        bool begin();
 
         // Opens the data file and prepares it for writing
         void open();
 
-        // Closes the data file
+        // Writes out any buffered data, and closes the data file
         void close();
 
+        // Writes out any buffered data and updates the file on the card
+        void sync();
+
+        // Sets when the buffer is written out (FLUSH_ON_FULL or 
+        // FLUSH_ON_AGE, with the maximum age in milliseconds)
+        void setFlushPolicy(uint8_t policy, unsigned long maxAge = DATAFILE_MAX_AGE);
+
+        // Logs to a file of the given size (bytes) which is allocated 
+        // in one piece, saving a commit to the journal every commitPeriod
+        // milliseconds. Must be called before begin(). If the file cannot
+        // be allocated, the normal mode is used.
+        void setContiguous(unsigned long size, 
+                           unsigned long commitPeriod = DATAFILE_COMMIT_PERIOD);
+
+        // Turns the time index file on or off, must be called before
+        // begin()
+        void setIndexing(bool indexing);
+
+        // Number of block writes which took the time of a latency bin, 
+        // and the longest write (microseconds)
+        unsigned int getLatencyCount(uint8_t bin);
+        unsigned long getMaxLatency();
+        void resetLatency();
+
+        // Sets the number of decimal places for floats in CSV files
+        // (up to FORMAT_MAX_PRECISION)
+        void setPrecision(uint8_t precision);
+
+        // Chooses the file format (FORMAT_CSV, FORMAT_BINARY or 
+        // FORMAT_COMPRESSED), must be called before begin()
+        void setFormat(uint8_t format);
+
         // Add an entry name to the data file. Data entries should be made
-        // in the order that this function was callled.
-        void addEntry(char const* entryName); 
+        // in the order that this function was callled. The type sets how
+        // the entry is stored in binary files (text is stored as zero).
+        void addEntry(char const* entryName, uint8_t type = DATA_FLOAT); 
 
         // Writes the descriptive header for the measurements in a 
         // specific data file
@@ -70,12 +282,48 @@ class DataFile
         void writeEntry(bool value);
         void writeEntry(char const* value);
 
+        // Writes a record which is already formatted as a whole row
+        // (used by BackgroundLogger). Binary records must hold the time
+        // and exactly one value per column, otherwise nothing is written
+        // and false is returned.
+        bool writeRecord(const uint8_t* data, uint8_t length);
+
+        // Adds an entry for each column of the schema, with the names
+        // given in order
+        template <typename... Types, typename... Names>
+        void addEntries(DataSchema<Types...> schema, Names... names);
+
+        // Writes a whole row at once, with a single time for the row. The
+        // number and types of the values must match the schema exactly
+        // (so use 5L for a long column, for example). Rows should not be 
+        // written part way through a row made of writeEntry() calls.
+        template <typename... Types, typename... Fields>
+        void writeRow(DataSchema<Types...> schema, Fields... fields);
+
         // Checks the status of the data file (whether or not is successfully
         // opened and it working)
         bool checkStatus();
 
     private:
 
+        // Whether the file is open for writing
+        bool isOpen();
+
+        // Contiguous mode: allocates the file and journal, cuts the log 
+        // from the previous run back to its last commit, and saves a 
+        // commit record
+        bool beginContiguous(uint8_t chipSelect, unsigned int number);
+        void recover(SdFile& root);
+        void commit();
+
+        // Adds a block write time to the histogram
+        void recordLatency(unsigned long time);
+
+        // Sets the number in the filename, and checks whether that file
+        // already exists on the card
+        void setFileNumber(unsigned int number);
+        bool fileExists(unsigned int number);
+
         // Writes a newline to the file
         void writeNewLine();
 
@@ -86,8 +334,147 @@ class DataFile
         // Writes either a comma or newline after an entry, depending
         // on whether the entry was the last in the line, or not
         void writeEntryEnd();
+
+        // Finishes a row, writing out the buffer if the flush policy 
+        // says the data has waited long enough
+        void endRow();
+
+        // Add the entries and write the fields of a row, one column at 
+        // a time (the versions with an empty schema end the recursion)
+        template <typename Type, typename... Types, typename Name, typename... Names>
+        void addSchemaEntries(DataSchema<Type, Types...> schema, Name name, Names... names);
+        void addSchemaEntries(DataSchema<>) {}
+
+        template <typename Type, typename... Types, typename Field, typename... Fields>
+        void writeTextFields(DataSchema<Type, Types...> schema, Field field, Fields... fields);
+        void writeTextFields(DataSchema<>) {}
+
+        template <typename Type, typename... Types, typename Field, typename... Fields>
+        void writeBinaryFields(DataSchema<Type, Types...> schema, Field field, Fields... fields);
+        void writeBinaryFields(DataSchema<>) {}
+
+        // Writes a single field of a row as text, or as a binary value
+        void writeText(bool value);
+        void writeText(int value);
+        void writeText(unsigned int value);
+        void writeText(long value);
+        void writeText(unsigned long value);
+        void writeText(double value);
+        void writeText(char const* value);
+
+        void writeBinaryField(bool value);
+        void writeBinaryField(int value);
+        void writeBinaryField(unsigned int value);
+        void writeBinaryField(long value);
+        void writeBinaryField(unsigned long value);
+        void writeBinaryField(double value);
+        void writeBinaryField(char const* value);
+
+        // Writes the header of a binary file
+        void writeBinaryHeader();
+
+        // Writes an entry to a binary file, as the column's type
+        void writeBinaryEntry(long value);
+        void writeBinaryEntry(unsigned long value);
+        void writeBinaryEntry(float value);
+        void writeBinaryColumn(uint32_t integer, float real);
+
+        // Called at the start of every row with its time, adds the row
+        // to the time index (and starts a keyframe) every 
+        // DATAFILE_INDEX_INTERVAL rows
+        void startRow(uint32_t time);
+
+        // Writes the waiting index entries to the index file
+        void writeIndex();
+
+        // Starts a binary row with its time, and writes each value in
+        // the row (compressed, in compressed files)
+        void startBinaryRow(uint32_t time);
+        void writeValue(uint32_t value, uint8_t size);
+
+        // Writes the lowest size bytes of value, least significant first,
+        // and reads them back
+        void writeBinary(uint32_t value, uint8_t size);
+        uint32_t readBinary(const uint8_t* data, uint8_t size);
+
+        // Size in bytes of a column type in binary files
+        uint8_t typeSize(uint8_t type);
+
+        // Adds text to the buffer, writing out each block as it fills
+        void print(char const* text);
+        void print(char c);
+        void print(char const* text, uint8_t length);
+
+        // Writes the buffered part of the current block to the file
+        void writeBuffer();
 };
 
 
+// Template functions have to be defined in the header
+
+template <typename... Types, typename... Names>
+void DataFile::addEntries(DataSchema<Types...> schema, Names... names)
+{
+    static_assert(sizeof...(Types) == sizeof...(Names), 
+                  "addEntries needs one name for each column of the schema");
+    static_assert(sizeof...(Types) <= NUM_ENTRIES, "too many columns in the schema");
+    addSchemaEntries(schema, names...);
+}
+
+
+template <typename... Types, typename... Fields>
+void DataFile::writeRow(DataSchema<Types...> schema, Fields... fields)
+{
+    static_assert(sizeof...(Types) == sizeof...(Fields), 
+                  "writeRow needs one value for each column of the schema");
+
+    if (!isOpen())
+        return;
+
+    unsigned long time = millis();
+    if (format_ != FORMAT_CSV)
+    {
+        startBinaryRow(time);
+        writeBinaryFields(schema, fields...);
+    }
+    else
+    {
+        startRow(time);
+        writeText(time);
+        writeTextFields(schema, fields...);
+        writeNewLine();
+    }
+    endRow();
+}
+
+
+template <typename Type, typename... Types, typename Name, typename... Names>
+void DataFile::addSchemaEntries(DataSchema<Type, Types...>, Name name, Names... names)
+{
+    addEntry(name, DataType<Type>::value);
+    addSchemaEntries(DataSchema<Types...>(), names...);
+}
+
+
+template <typename Type, typename... Types, typename Field, typename... Fields>
+void DataFile::writeTextFields(DataSchema<Type, Types...>, Field field, Fields... fields)
+{
+    static_assert(DataSameType<Type, Field>::value, 
+                  "writeRow value does not match the type of its column");
+    print(',');
+    writeText(field);
+    writeTextFields(DataSchema<Types...>(), fields...);
+}
+
+
+template <typename Type, typename... Types, typename Field, typename... Fields>
+void DataFile::writeBinaryFields(DataSchema<Type, Types...>, Field field, Fields... fields)
+{
+    static_assert(DataSameType<Type, Field>::value, 
+                  "writeRow value does not match the type of its column");
+    writeBinaryField(field);
+    writeBinaryFields(DataSchema<Types...>(), fields...);
+}
+
 
 #endif
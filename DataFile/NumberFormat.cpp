@@ -0,0 +1,162 @@
+// Written by Andrew Donelick
+// adonelick@hmc.edu
+
+#include "NumberFormat.h"
+#include <avr/pgmspace.h>
+
+// Powers of ten, largest first
+static const uint32_t powers32[] PROGMEM = {
+    1000000000UL, 100000000UL, 10000000UL, 1000000UL, 100000UL
+};
+
+static const uint16_t powers16[] PROGMEM = {
+    10000, 1000, 100, 10
+};
+
+// Scales for formatFloat(), 10^precision
+static const float floatScales[FORMAT_MAX_PRECISION + 1] PROGMEM = {
+    1.0, 10.0, 100.0, 1000.0, 10000.0, 100000.0, 1000000.0
+};
+
+
+// Writes the digits of value, with leading zeros if minDigits is more
+// than the number of digits, and returns the number of digits written
+static uint8_t formatDigits(char* text, unsigned long value, uint8_t minDigits)
+{
+    char* start = text;
+    bool started = false;
+
+    // Digits above 16 bits
+    for (uint8_t i = 0; i < 5; ++i)
+    {
+        uint32_t power = pgm_read_dword(&powers32[i]);
+        char digit = '0';
+        while (value >= power)
+        {
+            value -= power;
+            ++digit;
+        }
+
+        if (started || digit != '0' || minDigits >= 10 - i) {
+            *text++ = digit;
+            started = true;
+        }
+    }
+
+    // What is left is below 100000, but can still be above 65535
+    uint16_t small;
+    char digit = '0';
+    if (value >= 60000) {
+        value -= 60000;
+        digit += 6;
+    }
+    small = value;
+    while (small >= 10000)
+    {
+        small -= 10000;
+        ++digit;
+    }
+    if (started || digit != '0' || minDigits >= 5) {
+        *text++ = digit;
+        started = true;
+    }
+
+    for (uint8_t i = 1; i < 4; ++i)
+    {
+        uint16_t power = pgm_read_word(&powers16[i]);
+        digit = '0';
+        while (small >= power)
+        {
+            small -= power;
+            ++digit;
+        }
+
+        if (started || digit != '0' || minDigits >= 5 - i) {
+            *text++ = digit;
+            started = true;
+        }
+    }
+
+    *text++ = '0' + small;
+    *text = '\0';
+    return text - start;
+}
+
+
+uint8_t formatUnsigned(char* text, unsigned long value)
+{
+    return formatDigits(text, value, 1);
+}
+
+
+uint8_t formatLong(char* text, long value)
+{
+    if (value < 0)
+    {
+        *text = '-';
+        return 1 + formatDigits(text + 1, -(unsigned long) value, 1);
+    }
+    return formatDigits(text, value, 1);
+}
+
+
+uint8_t formatFixed(char* text, long value, uint8_t decimals)
+{
+    char* start = text;
+    unsigned long magnitude = value;
+    if (value < 0)
+    {
+        *text++ = '-';
+        magnitude = -(unsigned long) value;
+    }
+
+    // Write all the digits (at least one before the point), then move 
+    // the decimal places along to make room for the point
+    uint8_t length = formatDigits(text, magnitude, decimals + 1);
+    if (decimals > 0)
+    {
+        char* point = text + length - decimals;
+        memmove(point + 1, point, decimals + 1);
+        *point = '.';
+        ++length;
+    }
+
+    return (text - start) + length;
+}
+
+
+uint8_t formatFloat(char* text, float value, uint8_t precision)
+{
+    if (precision > FORMAT_MAX_PRECISION) {
+        precision = FORMAT_MAX_PRECISION;
+    }
+
+    if (isnan(value))
+    {
+        strcpy(text, "nan");
+        return 3;
+    }
+
+    if (isinf(value))
+    {
+        strcpy(text, value > 0 ? "inf" : "-inf");
+        return strlen(text);
+    }
+
+    float scaled = value * pgm_read_float(&floatScales[precision]);
+    if (scaled > 2147483000.0 || scaled < -2147483000.0)
+    {
+        strcpy(text, "ovf");
+        return 3;
+    }
+
+    // Like Print, write the sign of any negative value, even one which
+    // rounds to zero
+    if (value < 0)
+    {
+        *text = '-';
+        return 1 + formatFixed(text + 1, (long) (0.5 - scaled), precision);
+    }
+
+    return formatFixed(text, (long) (scaled + 0.5), precision);
+}
@@ -0,0 +1,50 @@
+// Written by Andrew Donelick
+// adonelick@hmc.edu
+
+/*
+ * Fast number formatting for logging. The AVR has no divide instruction,
+ * so itoa(), ultoa() and Print::print() spend most of their time in 
+ * software division (one 32 bit division for every digit), and printing
+ * a float also takes a float multiply and subtraction for every digit.
+ *
+ * These functions never divide. Each digit is found by subtracting its
+ * power of ten (from a table in flash) until the value is smaller, 
+ * which takes at most nine subtractions. Values which fit in 16 bits 
+ * use 16 bit subtractions. Floats are scaled once to a fixed point 
+ * integer and printed as one.
+ *
+ * Each function writes a null terminated string to text and returns its
+ * length. text must have room for FORMAT_BUFFER_SIZE characters.
+ */
+
+#ifndef NUMBER_FORMAT_H
+#define NUMBER_FORMAT_H 1
+
+#if ARDUINO >= 100
+#include "Arduino.h"       // for delayMicroseconds, digitalPinToBitMask, etc
+#else
+#include "WProgram.h"      // for delayMicroseconds
+#include "pins_arduino.h"  // for digitalPinToBitMask, etc
+#endif
+
+// Longest text produced (a sign, ten digits, a decimal point, and the
+// null)
+#define FORMAT_BUFFER_SIZE 14
+
+// Largest number of decimal places for formatFixed() and formatFloat()
+#define FORMAT_MAX_PRECISION 6
+
+// Formats an integer in decimal
+uint8_t formatUnsigned(char* text, unsigned long value);
+uint8_t formatLong(char* text, long value);
+
+// Formats a fixed point value: value / 10^decimals, with all of the 
+// decimal places written (so formatFixed(text, -5, 2) gives "-0.05")
+uint8_t formatFixed(char* text, long value, uint8_t decimals);
+
+// Formats a float rounded to the given number of decimal places. Like
+// Print, this gives "nan", "inf" or "-inf", and "ovf" for values which
+// are too large (here, too large to scale to a long)
+uint8_t formatFloat(char* text, float value, uint8_t precision);
+
+#endif
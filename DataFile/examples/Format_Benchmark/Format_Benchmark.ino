@@ -0,0 +1,95 @@
+// DataFile Example (Format benchmark)
+// Written by Andrew Donelick
+// <adonelick@hmc.edu>
+
+// Compares how fast numbers are formatted by Print and by the
+// NumberFormat functions DataFile uses, in characters per second.
+// Nothing is written to the SD card.
+
+#include <SD.h>
+#include <DataFile.h>
+#include <NumberFormat.h>
+
+#define NUM_VALUES 100
+
+// A Print which throws its output away, but counts it
+class NullPrint : public Print
+{
+  public:
+    unsigned long count;
+    NullPrint() : count(0) {}
+    size_t write(uint8_t) { ++count; return 1; }
+};
+
+NullPrint nullPrint;
+volatile char sink;
+
+// Prints the speed of one test
+void report(const char* name, unsigned long characters, unsigned long time)
+{
+  Serial.print(name);
+  Serial.print(": ");
+  Serial.print(characters * 1000000.0 / time, 0);
+  Serial.println(" chars/s");
+}
+
+void setup()
+{
+  Serial.begin(9600);
+  char text[FORMAT_BUFFER_SIZE];
+  unsigned long characters;
+  unsigned long start;
+
+  // Test values spread over the ranges seen in a log
+  randomSeed(1);
+  static long integers[NUM_VALUES];
+  static float reals[NUM_VALUES];
+  for (int i = 0; i < NUM_VALUES; ++i)
+  {
+    integers[i] = random(-100000000L, 100000000L) >> random(0, 24);
+    reals[i] = integers[i] / 1000.0;
+  }
+
+  nullPrint.count = 0;
+  start = micros();
+  for (int i = 0; i < NUM_VALUES; ++i) {
+    nullPrint.print(integers[i]);
+  }
+  report("Print long", nullPrint.count, micros() - start);
+
+  characters = 0;
+  start = micros();
+  for (int i = 0; i < NUM_VALUES; ++i) {
+    characters += formatLong(text, integers[i]);
+    sink = text[0];
+  }
+  report("formatLong", characters, micros() - start);
+
+  nullPrint.count = 0;
+  start = micros();
+  for (int i = 0; i < NUM_VALUES; ++i) {
+    nullPrint.print(reals[i], 2);
+  }
+  report("Print float", nullPrint.count, micros() - start);
+
+  characters = 0;
+  start = micros();
+  for (int i = 0; i < NUM_VALUES; ++i) {
+    characters += formatFloat(text, reals[i], 2);
+    sink = text[0];
+  }
+  report("formatFloat", characters, micros() - start);
+
+  characters = 0;
+  start = micros();
+  for (int i = 0; i < NUM_VALUES; ++i) {
+    characters += formatFixed(text, integers[i], 3);
+    sink = text[0];
+  }
+  report("formatFixed", characters, micros() - start);
+}
+
+void loop()
+{
+  // Nothing to do here...
+}
@@ -0,0 +1,149 @@
+// Written by Andrew Donelick
+// adonelick@hmc.edu
+
+/*
+ * The parts of the DataFile log formats which the ground station tools
+ * (binlog2csv, logslice and LogIndex.h) share: column types, magic 
+ * numbers, reading values and the journal's commit records. These must
+ * match DataFile.h.
+ */
+
+#ifndef LOG_FORMAT_H
+#define LOG_FORMAT_H 1
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+
+// Column types
+#define DATA_BOOL 1
+#define DATA_INT 2
+#define DATA_UINT 3
+#define DATA_LONG 4
+#define DATA_ULONG 5
+#define DATA_FLOAT 6
+
+// Binary and compressed logs start with one of these, then the version
+#define BINARY_MAGIC "SPKL"
+#define COMPRESSED_MAGIC "SPKZ"
+#define BINARY_VERSION 1
+
+// Time index files (LOG.IDX)
+#define INDEX_MAGIC "SPKI"
+#define INDEX_HEADER_SIZE 8
+#define INDEX_ENTRY_SIZE 8
+
+// Journals (LOG.JNL) hold two commit records (magic, sequence, length, 
+// rows, check), one at the start of each block
+#define DATAFILE_COMMIT_MAGIC 0x4C4E524AUL
+#define DATAFILE_COMMIT_SIZE 20
+#define DATAFILE_BLOCK_SIZE 512
+#define DATAFILE_JOURNAL_SIZE 1024
+
+struct Column
+{
+    uint8_t type;
+    std::string name;
+};
+
+
+static inline int typeSize(uint8_t type)
+{
+    switch (type)
+    {
+        case DATA_BOOL:
+            return 1;
+        case DATA_INT:
+        case DATA_UINT:
+            return 2;
+        default:
+            return 4;
+    }
+}
+
+
+static inline uint32_t readLittleEndian(const uint8_t* bytes, int size)
+{
+    uint32_t value = 0;
+    for (int i = size - 1; i >= 0; --i) {
+        value = (value << 8) | bytes[i];
+    }
+    return value;
+}
+
+
+// Undoes the zigzag encoding of a compressed value's change
+static inline uint32_t unzigzag(uint32_t zigzag)
+{
+    return (zigzag >> 1) ^ (0 - (zigzag & 1));
+}
+
+
+// Formats a value as text, returns the text length
+static inline int formatValue(char* out, uint32_t raw, uint8_t type)
+{
+    switch (type)
+    {
+        case DATA_BOOL:
+            return sprintf(out, (raw & 0xFF) ? "True" : "False");
+        case DATA_INT:
+            return sprintf(out, "%d", (int16_t) raw);
+        case DATA_UINT:
+            return sprintf(out, "%u", (unsigned) (uint16_t) raw);
+        case DATA_LONG:
+            return sprintf(out, "%ld", (long) (int32_t) raw);
+        case DATA_ULONG:
+            return sprintf(out, "%lu", (unsigned long) raw);
+        default:
+            float value;
+            memcpy(&value, &raw, 4);
+            return sprintf(out, "%.7g", value);
+    }
+}
+
+
+// The same file name with another extension, in the same case
+static inline std::string siblingName(const char* filename, const char* extension)
+{
+    std::string name = filename;
+    size_t dot = name.rfind('.');
+    if (dot == std::string::npos) {
+        return name + "." + extension;
+    }
+
+    std::string replacement = extension;
+    if (dot + 1 < name.size() && name[dot + 1] >= 'a') {
+        for (size_t i = 0; i < replacement.size(); ++i) {
+            replacement[i] = replacement[i] - 'A' + 'a';
+        }
+    }
+    return name.substr(0, dot + 1) + replacement;
+}
+
+
+// Length of the log from the newer valid commit record in a journal's 
+// data, or -1 if neither record is valid
+static inline long committedLength(const uint8_t* journal, size_t size)
+{
+    long length = -1;
+    uint32_t sequence = 0;
+    for (size_t offset = 0; offset + DATAFILE_COMMIT_SIZE <= size && offset < DATAFILE_JOURNAL_SIZE; 
+         offset += DATAFILE_BLOCK_SIZE)
+    {
+        uint32_t fields[5];
+        for (int j = 0; j < 5; ++j) {
+            fields[j] = readLittleEndian(journal + offset + 4*j, 4);
+        }
+        if (fields[0] == DATAFILE_COMMIT_MAGIC &&
+            fields[4] == (fields[0] ^ fields[1] ^ fields[2] ^ fields[3]) &&
+            (length < 0 || fields[1] > sequence)) {
+            length = fields[2];
+            sequence = fields[1];
+        }
+    }
+    return length;
+}
+
+
+#endif // LOG_FORMAT_H
@@ -0,0 +1,157 @@
+// Written by Andrew Donelick
+// adonelick@hmc.edu
+
+/*
+ * Reader for DataFile logs and their time indexes (DATAnnnn.IDX), for
+ * use on the ground station (Linux). The log and its index are memory
+ * mapped, and find() returns the position of the last indexed row at or
+ * before a time with a binary search over the index, so a time range 
+ * can be read from a long log without reading the rows before it.
+ *
+ * If the log has a journal (DATAnnnn.JNL, from contiguous mode), only
+ * the data up to its last commit is used.
+ *
+ * The index file is "SPKI", version, index interval and two spare bytes,
+ * followed by entries of a time and a position (4 bytes each, little 
+ * endian), one for every index interval rows.
+ */
+
+#ifndef LOG_INDEX_H
+#define LOG_INDEX_H 1
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "LogFormat.h"
+
+
+class LogIndex
+{
+    private:
+        const uint8_t* log_;
+        size_t logSize_;
+        size_t mappedSize_;
+        const uint8_t* index_;
+        size_t indexSize_;
+        size_t entries_;
+
+    public:
+
+        LogIndex() 
+            : log_(0), logSize_(0), mappedSize_(0), 
+              index_(0), indexSize_(0), entries_(0) {}
+
+        ~LogIndex()
+        {
+            if (log_) {
+                munmap((void*) log_, mappedSize_);
+            }
+            if (index_) {
+                munmap((void*) index_, indexSize_);
+            }
+        }
+
+        // Maps a log, and its index if there is one. Returns false if the
+        // log cannot be read.
+        bool open(const char* filename)
+        {
+            log_ = map(filename, mappedSize_);
+            if (!log_) {
+                return false;
+            }
+            logSize_ = mappedSize_;
+
+            long committed = journalLength(siblingName(filename, "JNL"));
+            if (committed >= 0 && (size_t) committed < logSize_) {
+                logSize_ = committed;
+            }
+
+            index_ = map(siblingName(filename, "IDX"), indexSize_);
+            if (index_ && (indexSize_ < INDEX_HEADER_SIZE || 
+                           memcmp(index_, INDEX_MAGIC, 4) != 0)) {
+                munmap((void*) index_, indexSize_);
+                index_ = 0;
+            }
+            entries_ = index_ ? (indexSize_ - INDEX_HEADER_SIZE) / INDEX_ENTRY_SIZE : 0;
+
+            // Entries past the end of the data are no use
+            while (entries_ > 0 && position(entries_ - 1) >= logSize_) {
+                --entries_;
+            }
+            return true;
+        }
+
+        // The log's data
+        const uint8_t* data() const { return log_; }
+        size_t size() const { return logSize_; }
+
+        // Number of index entries, and each entry's time and position
+        size_t entries() const { return entries_; }
+        uint32_t time(size_t entry) const { return read32(entry, 0); }
+        uint32_t position(size_t entry) const { return read32(entry, 4); }
+
+        // Position of the last indexed row with a time at or before the
+        // given time, or -1 if there is none
+        long find(uint32_t time) const
+        {
+            size_t low = 0;
+            size_t high = entries_;
+            while (low < high)
+            {
+                size_t middle = low + (high - low)/2;
+                if (this->time(middle) <= time) {
+                    low = middle + 1;
+                } else {
+                    high = middle;
+                }
+            }
+            return (low == 0) ? -1 : (long) position(low - 1);
+        }
+
+    private:
+
+        uint32_t read32(size_t entry, int offset) const
+        {
+            return readLittleEndian(index_ + INDEX_HEADER_SIZE + entry*INDEX_ENTRY_SIZE + offset, 4);
+        }
+
+        static const uint8_t* map(const std::string& filename, size_t& size)
+        {
+            int file = ::open(filename.c_str(), O_RDONLY);
+            if (file < 0) {
+                return 0;
+            }
+
+            struct stat status;
+            void* data = MAP_FAILED;
+            if (fstat(file, &status) == 0 && status.st_size > 0) {
+                size = status.st_size;
+                data = mmap(0, size, PROT_READ, MAP_PRIVATE, file, 0);
+            }
+            ::close(file);
+            return (data == MAP_FAILED) ? 0 : (const uint8_t*) data;
+        }
+
+        // Length from the newest valid commit record in a journal, or -1
+        static long journalLength(const std::string& journal)
+        {
+            size_t size;
+            const uint8_t* data = map(journal, size);
+            if (!data) {
+                return -1;
+            }
+
+            long length = committedLength(data, size);
+            munmap((void*) data, size);
+            return length;
+        }
+};
+
+
+#endif // LOG_INDEX_H
@@ -0,0 +1,382 @@
+// Written by Andrew Donelick
+// adonelick@hmc.edu
+
+/*
+ * Converts binary DataFile logs (FORMAT_BINARY, or FORMAT_COMPRESSED
+ * which it decompresses) into CSV, or into one raw little endian array
+ * per column. This runs on the ground station, not on the Arduino. 
+ * Build it with:
+ *
+ *     g++ -O2 -o binlog2csv binlog2csv.cpp
+ *
+ * Usage:
+ *     binlog2csv [LOG.BIN]              CSV on standard output
+ *     binlog2csv -c DIR [LOG.BIN]       DIR/Time.u32, DIR/<name>.<type>
+ *     binlog2csv -s ...                 also print the size of the log 
+ *                                       against uncompressed records
+ *
+ * With no file the log is read from standard input, so a log can be 
+ * converted as it streams in. A partial record at the end is ignored.
+ *
+ * Logs written in contiguous mode keep their full allocated size until
+ * the logger starts again. If LOG.JNL is next to LOG.BIN, only the data
+ * up to its last commit is converted.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include "LogFormat.h"
+
+#define READ_RECORDS 4096
+
+// Where the records come from, and how far through the log the reader is
+struct LogReader
+{
+    FILE* in;
+    std::vector<Column> columns;
+    int recordSize;
+
+    // Bytes which can still be read (-1 when there is no limit)
+    long left;
+
+    // Compressed logs: keyframe interval, rows until the next keyframe,
+    // and each value of the previous row
+    bool compressed;
+    int keyframe;
+    int rowsToKeyframe;
+    std::vector<uint32_t> previous;
+
+    // Totals, for -s
+    unsigned long bytes;
+    unsigned long rows;
+};
+
+
+static const char* typeExtension(uint8_t type)
+{
+    switch (type)
+    {
+        case DATA_BOOL:  return "u8";
+        case DATA_INT:   return "i16";
+        case DATA_UINT:  return "u16";
+        case DATA_LONG:  return "i32";
+        case DATA_ULONG: return "u32";
+        default:         return "f32";
+    }
+}
+
+
+// Reads the header into the reader, returns false if it is not valid
+static bool readHeader(LogReader& log)
+{
+    uint8_t header[8];
+    if (fread(header, 1, 8, log.in) != 8) {
+        fprintf(stderr, "binlog2csv: not a binary DataFile log\n");
+        return false;
+    }
+
+    if (memcmp(header, COMPRESSED_MAGIC, 4) == 0) {
+        log.compressed = true;
+    } else if (memcmp(header, BINARY_MAGIC, 4) == 0) {
+        log.compressed = false;
+    } else {
+        fprintf(stderr, "binlog2csv: not a binary DataFile log\n");
+        return false;
+    }
+
+    if (header[4] != BINARY_VERSION) {
+        fprintf(stderr, "binlog2csv: unknown format version %d\n", header[4]);
+        return false;
+    }
+
+    log.recordSize = 4;
+    for (int i = 0; i < header[5]; ++i)
+    {
+        uint8_t description[2];
+        char name[256];
+        if (fread(description, 1, 2, log.in) != 2 ||
+            fread(name, 1, description[1], log.in) != description[1]) {
+            fprintf(stderr, "binlog2csv: header is cut short\n");
+            return false;
+        }
+
+        Column column;
+        column.type = description[0];
+        column.name.assign(name, description[1]);
+        log.columns.push_back(column);
+        log.recordSize += typeSize(column.type);
+    }
+
+    if (log.recordSize != (int) readLittleEndian(header + 6, 2)) {
+        fprintf(stderr, "binlog2csv: record size does not match the columns\n");
+        return false;
+    }
+
+    if (log.compressed)
+    {
+        int keyframe = fgetc(log.in);
+        if (keyframe <= 0) {
+            fprintf(stderr, "binlog2csv: header is cut short\n");
+            return false;
+        }
+        log.keyframe = keyframe;
+        log.rowsToKeyframe = 0;
+        log.previous.assign(log.columns.size() + 1, 0);
+    }
+
+    return true;
+}
+
+
+// Length of the log from the last commit in its journal (LOG.JNL for
+// LOG.BIN), or -1 if there is no journal
+static long journalLength(const char* filename)
+{
+    FILE* journal = fopen(siblingName(filename, "JNL").c_str(), "rb");
+    if (!journal) {
+        return -1;
+    }
+
+    uint8_t data[DATAFILE_JOURNAL_SIZE];
+    size_t size = fread(data, 1, DATAFILE_JOURNAL_SIZE, journal);
+    fclose(journal);
+    return committedLength(data, size);
+}
+
+
+// Reads one byte, counting it against the limit. Returns -1 at the end.
+static int readByte(LogReader& log)
+{
+    if (log.left == 0) {
+        return -1;
+    }
+
+    int c = fgetc(log.in);
+    if (c != EOF && log.left > 0) {
+        --log.left;
+    }
+    return c;
+}
+
+
+// Decodes one compressed row into a record. Returns false at the end of
+// the log (a row which is cut short is dropped).
+static bool decodeRecord(LogReader& log, uint8_t* record)
+{
+    if (log.rowsToKeyframe == 0)
+    {
+        std::fill(log.previous.begin(), log.previous.end(), 0);
+        log.rowsToKeyframe = log.keyframe;
+    }
+    --log.rowsToKeyframe;
+
+    for (size_t i = 0; i < log.previous.size(); ++i)
+    {
+        uint32_t zigzag = 0;
+        int shift = 0;
+        int c;
+        do {
+            c = readByte(log);
+            if (c < 0 || shift > 28) {
+                return false;
+            }
+            zigzag |= (uint32_t) (c & 0x7F) << shift;
+            shift += 7;
+        } while (c & 0x80);
+
+        uint32_t value = log.previous[i] + unzigzag(zigzag);
+        log.previous[i] = value;
+
+        int size = (i == 0) ? 4 : typeSize(log.columns[i - 1].type);
+        for (int j = 0; j < size; ++j) {
+            *record++ = value >> (8*j);
+        }
+    }
+
+    return true;
+}
+
+
+// Reads up to READ_RECORDS whole records
+static size_t readRecords(LogReader& log, uint8_t* records)
+{
+    size_t count = 0;
+    if (log.compressed)
+    {
+        while (count < READ_RECORDS && decodeRecord(log, records + count*log.recordSize)) {
+            ++count;
+        }
+    }
+    else
+    {
+        count = READ_RECORDS;
+        if (log.left >= 0 && (long) count > log.left / log.recordSize) {
+            count = log.left / log.recordSize;
+        }
+
+        count = fread(records, log.recordSize, count, log.in);
+        if (log.left >= 0) {
+            log.left -= count * log.recordSize;
+        }
+    }
+
+    log.rows += count;
+    return count;
+}
+
+
+// Formats one value of a record as text, returns the text length
+static int formatField(char* out, const uint8_t* bytes, uint8_t type)
+{
+    return formatValue(out, readLittleEndian(bytes, typeSize(type)), type);
+}
+
+
+static void writeCsv(LogReader& log)
+{
+    const std::vector<Column>& columns = log.columns;
+    int recordSize = log.recordSize;
+
+    printf("Time");
+    for (size_t i = 0; i < columns.size(); ++i) {
+        printf(",%s", columns[i].name.c_str());
+    }
+    printf("\n");
+
+    std::vector<uint8_t> records(recordSize * READ_RECORDS);
+    std::vector<char> text(READ_RECORDS * (11 + 16 * columns.size()) + 1);
+
+    size_t count;
+    while ((count = readRecords(log, &records[0])) > 0)
+    {
+        char* out = &text[0];
+        for (size_t r = 0; r < count; ++r)
+        {
+            const uint8_t* record = &records[r * recordSize];
+            out += sprintf(out, "%lu", (unsigned long) readLittleEndian(record, 4));
+
+            const uint8_t* field = record + 4;
+            for (size_t i = 0; i < columns.size(); ++i)
+            {
+                *out++ = ',';
+                out += formatField(out, field, columns[i].type);
+                field += typeSize(columns[i].type);
+            }
+            *out++ = '\n';
+        }
+        fwrite(&text[0], 1, out - &text[0], stdout);
+    }
+}
+
+
+static bool writeColumns(LogReader& log, const std::string& directory)
+{
+    const std::vector<Column>& columns = log.columns;
+    int recordSize = log.recordSize;
+
+    std::vector<FILE*> files;
+    std::string path = directory + "/Time.u32";
+    files.push_back(fopen(path.c_str(), "wb"));
+    for (size_t i = 0; i < columns.size(); ++i) {
+        path = directory + "/" + columns[i].name + "." + typeExtension(columns[i].type);
+        files.push_back(fopen(path.c_str(), "wb"));
+    }
+
+    for (size_t i = 0; i < files.size(); ++i) {
+        if (!files[i]) {
+            fprintf(stderr, "binlog2csv: cannot create column files in %s\n", directory.c_str());
+            return false;
+        }
+    }
+
+    // Records are already little endian, so each field is copied as is
+    std::vector<uint8_t> records(recordSize * READ_RECORDS);
+    std::vector<uint8_t> column(4 * READ_RECORDS);
+
+    size_t count;
+    while ((count = readRecords(log, &records[0])) > 0)
+    {
+        int offset = 0;
+        for (size_t i = 0; i < files.size(); ++i)
+        {
+            int size = (i == 0) ? 4 : typeSize(columns[i - 1].type);
+            for (size_t r = 0; r < count; ++r) {
+                memcpy(&column[r * size], &records[r * recordSize + offset], size);
+            }
+            fwrite(&column[0], size, count, files[i]);
+            offset += size;
+        }
+    }
+
+    for (size_t i = 0; i < files.size(); ++i) {
+        fclose(files[i]);
+    }
+    return true;
+}
+
+
+int main(int argc, char* argv[])
+{
+    std::string directory;
+    const char* filename = 0;
+    bool statistics = false;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "-c") == 0 && i + 1 < argc) {
+            directory = argv[++i];
+        } else if (strcmp(argv[i], "-s") == 0) {
+            statistics = true;
+        } else if (argv[i][0] == '-') {
+            fprintf(stderr, "usage: binlog2csv [-s] [-c DIR] [LOG.BIN]\n");
+            return 2;
+        } else {
+            filename = argv[i];
+        }
+    }
+
+    LogReader log;
+    log.in = filename ? fopen(filename, "rb") : stdin;
+    log.left = -1;
+    log.rows = 0;
+    if (!log.in) {
+        perror(filename);
+        return 1;
+    }
+
+    if (!readHeader(log)) {
+        return 1;
+    }
+
+    // Only read up to the last commit, if there is a journal
+    long length = filename ? journalLength(filename) : -1;
+    long start = ftell(log.in);
+    if (length >= 0) {
+        log.left = (length > start) ? length - start : 0;
+    }
+
+    if (directory.empty()) {
+        writeCsv(log);
+    } else if (!writeColumns(log, directory)) {
+        return 1;
+    }
+
+    if (statistics)
+    {
+        unsigned long stored = ftell(log.in) - start;
+        unsigned long raw = log.rows * log.recordSize;
+        fprintf(stderr, "%lu rows, %lu bytes stored, %lu bytes as records", 
+                log.rows, stored, raw);
+        if (stored > 0) {
+            fprintf(stderr, " (ratio %.2f)", (double) raw / stored);
+        }
+        fprintf(stderr, "\n");
+    }
+
+    return 0;
+}
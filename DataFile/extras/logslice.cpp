@@ -0,0 +1,313 @@
+// Written by Andrew Donelick
+// adonelick@hmc.edu
+
+/*
+ * Prints the rows of a DataFile log (CSV, binary or compressed) between
+ * two times as CSV, optionally with only some of the columns. The time
+ * index (LOG.IDX) is used to jump to the first row needed, so only the
+ * rows near the time range are read. Without an index the log is read 
+ * from the start. This runs on the ground station. Build it with:
+ *
+ *     g++ -O2 -o logslice logslice.cpp
+ *
+ * Usage:
+ *     logslice [-c NAME,NAME,...] START END LOG
+ *
+ * START and END are times in milliseconds, as logged.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "LogIndex.h"
+
+static void printValue(uint32_t raw, uint8_t type)
+{
+    char text[32];
+    formatValue(text, raw, type);
+    fputs(text, stdout);
+}
+
+
+// Which columns to print: every column if no names are given
+static std::vector<int> selectColumns(const std::vector<std::string>& names, 
+                                      const std::string& wanted)
+{
+    std::vector<int> selected;
+    if (wanted.empty())
+    {
+        for (size_t i = 0; i < names.size(); ++i) {
+            selected.push_back(i);
+        }
+        return selected;
+    }
+
+    size_t start = 0;
+    while (start <= wanted.size())
+    {
+        size_t end = wanted.find(',', start);
+        if (end == std::string::npos) {
+            end = wanted.size();
+        }
+
+        std::string name = wanted.substr(start, end - start);
+        size_t i = 0;
+        while (i < names.size() && names[i] != name) {
+            ++i;
+        }
+        if (i == names.size()) {
+            fprintf(stderr, "logslice: no column named %s\n", name.c_str());
+            exit(1);
+        }
+        selected.push_back(i);
+        start = end + 1;
+    }
+    return selected;
+}
+
+
+static void printHeader(const std::vector<std::string>& names, const std::vector<int>& selected)
+{
+    fputs("Time", stdout);
+    for (size_t i = 0; i < selected.size(); ++i) {
+        printf(",%s", names[selected[i]].c_str());
+    }
+    fputs("\n", stdout);
+}
+
+
+static void sliceCsv(const LogIndex& log, uint32_t start, uint32_t end, const std::string& wanted)
+{
+    const char* data = (const char*) log.data();
+    const char* last = data + log.size();
+
+    // The header: Time, then the column names
+    const char* line = data;
+    const char* lineEnd = (const char*) memchr(line, '\n', last - line);
+    if (!lineEnd) {
+        return;
+    }
+
+    std::vector<std::string> names;
+    const char* field = line;
+    while (field < lineEnd)
+    {
+        const char* fieldEnd = field;
+        while (fieldEnd < lineEnd && *fieldEnd != ',' && *fieldEnd != '\r') {
+            ++fieldEnd;
+        }
+        names.push_back(std::string(field, fieldEnd));
+        field = fieldEnd + 1;
+        if (*fieldEnd == '\r') {
+            break;
+        }
+    }
+    names.erase(names.begin());
+
+    std::vector<int> selected = selectColumns(names, wanted);
+    printHeader(names, selected);
+
+    long position = log.find(start);
+    line = (position >= 0) ? data + position : lineEnd + 1;
+
+    std::vector<const char*> fields;
+    std::vector<int> lengths;
+    while (line < last)
+    {
+        lineEnd = (const char*) memchr(line, '\n', last - line);
+        if (!lineEnd) {
+            break;
+        }
+
+        uint32_t time = strtoul(line, 0, 10);
+        if (time > end) {
+            break;
+        }
+
+        if (time >= start)
+        {
+            // Split the row, the first field being the time
+            fields.clear();
+            lengths.clear();
+            field = line;
+            while (field <= lineEnd)
+            {
+                const char* fieldEnd = field;
+                while (fieldEnd < lineEnd && *fieldEnd != ',' && *fieldEnd != '\r') {
+                    ++fieldEnd;
+                }
+                fields.push_back(field);
+                lengths.push_back(fieldEnd - field);
+                if (*fieldEnd != ',') {
+                    break;
+                }
+                field = fieldEnd + 1;
+            }
+
+            printf("%lu", (unsigned long) time);
+            for (size_t i = 0; i < selected.size(); ++i)
+            {
+                int f = selected[i] + 1;
+                if (f < (int) fields.size()) {
+                    printf(",%.*s", lengths[f], fields[f]);
+                } else {
+                    fputs(",", stdout);
+                }
+            }
+            fputs("\n", stdout);
+        }
+        line = lineEnd + 1;
+    }
+}
+
+
+// Reads a value from a binary or compressed row, moving along the data.
+// Returns false if the data ends part way through the value.
+static bool readValue(const uint8_t*& data, const uint8_t* last, bool compressed, 
+                      int size, uint32_t& previous, uint32_t& value)
+{
+    if (!compressed)
+    {
+        if (last - data < size) {
+            return false;
+        }
+        value = readLittleEndian(data, size);
+        data += size;
+        return true;
+    }
+
+    uint32_t zigzag = 0;
+    int shift = 0;
+    uint8_t c;
+    do {
+        if (data == last || shift > 28) {
+            return false;
+        }
+        c = *data++;
+        zigzag |= (uint32_t) (c & 0x7F) << shift;
+        shift += 7;
+    } while (c & 0x80);
+
+    value = previous + unzigzag(zigzag);
+    previous = value;
+    return true;
+}
+
+
+static void sliceBinary(const LogIndex& log, uint32_t start, uint32_t end, const std::string& wanted)
+{
+    const uint8_t* data = log.data();
+    const uint8_t* last = data + log.size();
+    bool compressed = memcmp(data, COMPRESSED_MAGIC, 4) == 0;
+
+    // The header: magic, version, columns, record size, then each column
+    // (and the keyframe interval, if compressed)
+    const uint8_t* header = data + 8;
+    std::vector<Column> columns;
+    std::vector<std::string> names;
+    for (int i = 0; i < data[5]; ++i)
+    {
+        if (last - header < 2 || last - header < 2 + header[1]) {
+            return;
+        }
+        Column column;
+        column.type = header[0];
+        column.name.assign((const char*) header + 2, header[1]);
+        columns.push_back(column);
+        names.push_back(column.name);
+        header += 2 + header[1];
+    }
+
+    int keyframe = 1;
+    if (compressed) {
+        keyframe = *header++;
+    }
+
+    std::vector<int> selected = selectColumns(names, wanted);
+    printHeader(names, selected);
+
+    // Indexed rows are keyframes, so decoding can start at any of them
+    long position = log.find(start);
+    const uint8_t* row = (position >= 0) ? data + position : header;
+
+    std::vector<uint32_t> previous(columns.size() + 1);
+    std::vector<uint32_t> values(columns.size());
+    int rowsToKeyframe = 0;
+    while (row < last)
+    {
+        if (rowsToKeyframe == 0)
+        {
+            std::fill(previous.begin(), previous.end(), 0);
+            rowsToKeyframe = keyframe;
+        }
+        --rowsToKeyframe;
+
+        uint32_t time;
+        if (!readValue(row, last, compressed, 4, previous[0], time)) {
+            break;
+        }
+
+        bool complete = true;
+        for (size_t i = 0; i < columns.size() && complete; ++i) {
+            complete = readValue(row, last, compressed, typeSize(columns[i].type), 
+                                 previous[i + 1], values[i]);
+        }
+        if (!complete || time > end) {
+            break;
+        }
+
+        if (time >= start)
+        {
+            printf("%lu", (unsigned long) time);
+            for (size_t i = 0; i < selected.size(); ++i)
+            {
+                fputs(",", stdout);
+                printValue(values[selected[i]], columns[selected[i]].type);
+            }
+            fputs("\n", stdout);
+        }
+    }
+}
+
+
+int main(int argc, char* argv[])
+{
+    std::string wanted;
+    std::vector<const char*> arguments;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "-c") == 0 && i + 1 < argc) {
+            wanted = argv[++i];
+        } else {
+            arguments.push_back(argv[i]);
+        }
+    }
+
+    if (arguments.size() != 3) {
+        fprintf(stderr, "usage: logslice [-c NAME,NAME,...] START END LOG\n");
+        return 2;
+    }
+
+    uint32_t start = strtoul(arguments[0], 0, 10);
+    uint32_t end = strtoul(arguments[1], 0, 10);
+
+    LogIndex log;
+    if (!log.open(arguments[2])) {
+        perror(arguments[2]);
+        return 1;
+    }
+
+    if (log.size() >= 8 && (memcmp(log.data(), BINARY_MAGIC, 4) == 0 ||
+                            memcmp(log.data(), COMPRESSED_MAGIC, 4) == 0)) {
+        sliceBinary(log, start, end, wanted);
+    } else {
+        sliceCsv(log, start, end, wanted);
+    }
+
+    return 0;
+}
@@ -0,0 +1,244 @@
+// Written by Andrew Donelick
+// adonelick@hmc.edu
+
+#include "HeaterController.h"
+
+HeaterController::HeaterController(Sensors& sensors, RelayModule& relays, int relayIndex)
+    : sensors_(sensors),
+      relays_(relays),
+      relayIndex_(relayIndex),
+      mode_(HEATER_AUTO),
+      manualDuty_(0),
+      target_(HEATER_DEFAULT_TARGET),
+      hysteresis_(HEATER_DEFAULT_HYSTERESIS),
+      gain_(HEATER_DEFAULT_GAIN),
+      heaterLimit_(HEATER_DEFAULT_LIMIT),
+      heating_(false),
+      duty_(0),
+      windowStart_(0),
+      relayOn_(false),
+      overheated_(false),
+      power_(0),
+      budget_(0),
+      flightLength_(0),
+      flightStart_(0),
+      energy_(0),
+      energyRemainder_(0),
+      onTime_(0),
+      lastUpdate_(0)
+{
+    // Nothing to do here...
+}
+
+
+void HeaterController::begin()
+{
+    relayOn_ = true;
+    switchHeater(false);
+
+    flightStart_ = millis();
+    lastUpdate_ = flightStart_;
+
+    // Start a new window on the first update
+    windowStart_ = flightStart_ - HEATER_WINDOW;
+}
+
+
+void HeaterController::setMode(uint8_t mode)
+{
+    mode_ = mode;
+
+    // Start a new window, so the change takes effect straight away
+    windowStart_ = millis() - HEATER_WINDOW;
+}
+
+
+void HeaterController::setManualDuty(uint8_t duty)
+{
+    manualDuty_ = duty;
+}
+
+
+uint8_t HeaterController::getMode()
+{
+    return mode_;
+}
+
+
+void HeaterController::setTarget(long target, long hysteresis)
+{
+    target_ = target;
+    hysteresis_ = hysteresis;
+}
+
+
+void HeaterController::setGain(long gain)
+{
+    gain_ = gain;
+}
+
+
+void HeaterController::setHeaterLimit(long limit)
+{
+    heaterLimit_ = limit;
+}
+
+
+void HeaterController::setBudget(unsigned long power, unsigned long milliwattHours, 
+                                 unsigned long flightSeconds)
+{
+    power_ = power;
+    budget_ = milliwattHours * 3600;
+    flightLength_ = flightSeconds * 1000;
+}
+
+
+void HeaterController::update()
+{
+    unsigned long now = millis();
+
+    // Count the energy used since the last update
+    unsigned long elapsed = now - lastUpdate_;
+    lastUpdate_ = now;
+    if (relayOn_)
+    {
+        onTime_ += elapsed;
+        energyRemainder_ += elapsed * power_;
+        energy_ += energyRemainder_ / 1000;
+        energyRemainder_ %= 1000;
+    }
+
+    long heater = sensors_.getAnalogTemperatureCenti(HEATER_TEMP);
+    if (heater > heaterLimit_) {
+        overheated_ = true;
+    }
+
+    if (now - windowStart_ >= HEATER_WINDOW)
+    {
+        windowStart_ = now;
+
+        // Once too hot, wait until the heater has cooled by the
+        // hysteresis before using it again
+        if (heater < heaterLimit_ - hysteresis_) {
+            overheated_ = false;
+        }
+
+        if (mode_ == HEATER_ON) {
+            duty_ = HEATER_FULL_DUTY;
+        } else if (mode_ == HEATER_OFF) {
+            duty_ = 0;
+        } else if (mode_ == HEATER_MANUAL) {
+            duty_ = manualDuty_;
+        } else {
+            duty_ = calculateDuty(sensors_.getAnalogTemperatureCenti(INTERNAL_TEMP));
+        }
+    }
+
+    bool budgetUsed = power_ > 0 && energy_ >= budget_;
+    unsigned long onLength = HEATER_WINDOW * duty_ / HEATER_FULL_DUTY;
+    switchHeater(!overheated_ && !budgetUsed && now - windowStart_ < onLength);
+}
+
+
+uint8_t HeaterController::calculateDuty(long internal)
+{
+    // Hysteresis: start heating below the band, stop above it
+    if (internal < target_ - hysteresis_) {
+        heating_ = true;
+    } else if (internal > target_ + hysteresis_) {
+        heating_ = false;
+    }
+
+    if (!heating_)
+        return 0;
+
+    long duty = (target_ + hysteresis_ - internal) * gain_ / 100;
+    if (duty > HEATER_FULL_DUTY) {
+        duty = HEATER_FULL_DUTY;
+    } else if (duty < 0) {
+        duty = 0;
+    }
+
+    uint8_t limit = budgetDuty();
+    return (duty > limit) ? limit : duty;
+}
+
+
+uint8_t HeaterController::budgetDuty()
+{
+    if (power_ == 0)
+        return HEATER_FULL_DUTY;
+
+    if (energy_ >= budget_)
+        return 0;
+
+    unsigned long flown = millis() - flightStart_;
+    if (flown >= flightLength_)
+        return HEATER_FULL_DUTY;
+
+    // Energy left (mJ) against the energy of running flat out for the
+    // rest of the flight (in mJ, the power times the seconds left)
+    unsigned long left = budget_ - energy_;
+    unsigned long fullOn = power_ * ((flightLength_ - flown) / 1000);
+    if (fullOn == 0 || left >= fullOn)
+        return HEATER_FULL_DUTY;
+
+    // left < fullOn, so scaling left by 255 overflows only for budgets 
+    // above 16000 J, in which case fullOn is scaled down instead
+    if (left < 0xFFFFFFFFUL / HEATER_FULL_DUTY) {
+        return left * HEATER_FULL_DUTY / fullOn;
+    }
+    return left / (fullOn / HEATER_FULL_DUTY);
+}
+
+
+uint8_t HeaterController::getDuty()
+{
+    return duty_;
+}
+
+
+uint8_t HeaterController::getAverageDuty()
+{
+    unsigned long flown = millis() - flightStart_;
+    if (flown == 0)
+        return 0;
+
+    // Scaled to seconds so the multiply by 100 cannot overflow
+    if (flown < 0xFFFFFFFFUL / 100) {
+        return onTime_ * 100 / flown;
+    }
+    return (onTime_ / 1000) * 100 / (flown / 1000);
+}
+
+
+unsigned long HeaterController::getEnergyUsed()
+{
+    return energy_ / 3600;
+}
+
+
+bool HeaterController::heaterOn()
+{
+    return relayOn_;
+}
+
+
+bool HeaterController::overheated()
+{
+    return overheated_;
+}
+
+
+void HeaterController::switchHeater(bool on)
+{
+    if (on == relayOn_)
+        return;
+
+    relayOn_ = on;
+    if (on) {
+        relays_.switchRelayOn(relayIndex_);
+    } else {
+        relays_.switchRelayOff(relayIndex_);
+    }
+}
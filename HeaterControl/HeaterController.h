@@ -0,0 +1,148 @@
+// Written by Andrew Donelick
+// adonelick@hmc.edu
+
+// This class keeps the payload electronics warm with the heater, while 
+// staying within an energy budget for the flight. The heater relay is
+// switched with a time proportioned duty cycle: in every HEATER_WINDOW
+// the relay is on for duty/255 of the window. In automatic mode the 
+// duty comes from the internal temperature, with hysteresis around the
+// target, and is limited so the energy left in the budget lasts for the
+// rest of the flight. The heater is always turned off if the heater's
+// own temperature sensor reads above its limit, or once the whole 
+// budget is used.
+
+
+#ifndef HEATER_CONTROLLER_H
+#define HEATER_CONTROLLER_H 1
+
+#include <inttypes.h>
+
+#if ARDUINO >= 100
+#include "Arduino.h"       // for delayMicroseconds, digitalPinToBitMask, etc
+#else
+#include "WProgram.h"      // for delayMicroseconds
+#include "pins_arduino.h"  // for digitalPinToBitMask, etc
+#endif
+
+#include "Sensors.h"
+#include "RelayModule.h"
+
+// Heater modes: automatic, held on or off (TURN_HEATER_ON and
+// TURN_HEATER_OFF), or a fixed duty (MANUAL_HEATER_CONTROL)
+#define HEATER_AUTO 0
+#define HEATER_ON 1
+#define HEATER_OFF 2
+#define HEATER_MANUAL 3
+
+// Length of one duty cycle window (ms), and the full duty
+#define HEATER_WINDOW 10000UL
+#define HEATER_FULL_DUTY 255
+
+// Defaults: target internal temperature and hysteresis (0.01 degrees C),
+// duty per degree below the top of the band, and the highest the heater
+// itself may get (0.01 degrees C)
+#define HEATER_DEFAULT_TARGET 1000
+#define HEATER_DEFAULT_HYSTERESIS 200
+#define HEATER_DEFAULT_GAIN 64
+#define HEATER_DEFAULT_LIMIT 6000
+
+
+class HeaterController
+{
+
+private:
+
+    Sensors& sensors_;
+    RelayModule& relays_;
+    int relayIndex_;
+
+    uint8_t mode_;
+    uint8_t manualDuty_;
+
+    // Thermostat settings (0.01 degrees C, and duty per degree)
+    long target_;
+    long hysteresis_;
+    long gain_;
+    long heaterLimit_;
+    bool heating_;
+
+    // Duty for the current window, when the window started, and 
+    // whether the relay is on
+    uint8_t duty_;
+    unsigned long windowStart_;
+    bool relayOn_;
+    bool overheated_;
+
+    // Energy budget: heater power (mW), budget (mJ), flight length and
+    // start (ms), and the energy used (mJ) with the part of a mJ left 
+    // over (mW ms)
+    unsigned long power_;
+    unsigned long budget_;
+    unsigned long flightLength_;
+    unsigned long flightStart_;
+    unsigned long energy_;
+    unsigned long energyRemainder_;
+
+    // Total time the heater has been on, and the last update (ms)
+    unsigned long onTime_;
+    unsigned long lastUpdate_;
+
+public:
+
+    HeaterController(Sensors& sensors, RelayModule& relays, int relayIndex);
+
+    // Turns the heater off and starts the flight clock
+    void begin();
+
+    // Sets the mode (HEATER_AUTO, HEATER_ON, HEATER_OFF or 
+    // HEATER_MANUAL), and the duty (0 to 255) used in manual mode
+    void setMode(uint8_t mode);
+    void setManualDuty(uint8_t duty);
+    uint8_t getMode();
+
+    // Sets the target internal temperature and the hysteresis on each
+    // side of it (0.01 degrees C), and the duty per degree C below the
+    // top of the band
+    void setTarget(long target, long hysteresis = HEATER_DEFAULT_HYSTERESIS);
+    void setGain(long gain);
+
+    // Sets the highest temperature the heater may reach (0.01 degrees C)
+    void setHeaterLimit(long limit);
+
+    // Sets the heater's power (milliwatts), and the energy it may use
+    // (milliwatt hours) over a flight of the given length (seconds)
+    void setBudget(unsigned long power, unsigned long milliwattHours, 
+                   unsigned long flightSeconds);
+
+    // Reads the temperatures and switches the heater, call it often 
+    // (at least every few hundred milliseconds)
+    void update();
+
+    // Duty of the current window (0 to 255), the fraction of the flight
+    // the heater has been on (percent), and the energy used so far
+    // (milliwatt hours)
+    uint8_t getDuty();
+    uint8_t getAverageDuty();
+    unsigned long getEnergyUsed();
+
+    // Whether the heater is on, and whether it was cut off for being
+    // too hot (it stays off until it is the hysteresis below its limit)
+    bool heaterOn();
+    bool overheated();
+
+private:
+
+    // Works out the duty for a new window
+    uint8_t calculateDuty(long internal);
+
+    // Largest duty which leaves enough of the budget for the rest of
+    // the flight
+    uint8_t budgetDuty();
+
+    // Switches the relay, if it is not already in that state
+    void switchHeater(bool on);
+
+};
+
+
+#endif
@@ -39,6 +39,7 @@
 #define REPORT 0x1111
 #define COMMAND 0x2222
 #define COMMAND_RESPONSE 0x3333
+#define COMMAND_BATCH 0x4444
 
 
 
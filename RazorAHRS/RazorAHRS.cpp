@@ -5,80 +5,127 @@
 #include "RazorAHRS.h"
 
 RazorAHRS::RazorAHRS(HardwareSerial& razorSerial)
-    : razorSerial_(razorSerial)
+    : razorSerial_(razorSerial),
+      framePosition_(0),
+      frameReady_(false),
+      requestInterval_(0),
+      lastRequestTime_(0),
+      windowStart_(0),
+      windowFrames_(0),
+      windowOpen_(false),
+      frameInterval_(0)
 {
     // Nothing else to do here...
 }
 
-void RazorAHRS::begin()
+bool RazorAHRS::begin(unsigned long baud, uint16_t frameRate)
 {
-    razorSerial_.begin(57600);
+    // The serial link can carry at most one frame per 
+    // RAZOR_FRAME_LENGTH bytes of 10 bits each
+    uint16_t maxRate = baud / (10UL * RAZOR_FRAME_LENGTH);
+    if (frameRate == 0 || frameRate > maxRate) {
+        frameRate = maxRate;
+    }
+
+    razorSerial_.begin(baud);
     razorSerial_.write("#ob");  // Turn on binary output
-    razorSerial_.write("#o1");  // Turn on continuous streaming output
     razorSerial_.write("#oe0"); // Disable error message output
+
+    if (frameRate < RAZOR_STREAM_RATE) {
+        // Slower than the firmware streams: request single frames
+        razorSerial_.write("#o0");
+        requestInterval_ = 1000000UL / frameRate;
+        lastRequestTime_ = micros() - requestInterval_;
+    } else {
+        razorSerial_.write("#o1");  // Turn on continuous streaming output
+        requestInterval_ = 0;
+    }
+
+    // Throw away anything sent before the new settings took effect,
+    // then time the incoming frames until the rate is known
+    razorSerial_.flush();
+    while (razorSerial_.available()) {
+        razorSerial_.read();
+    }
+    resetFrames();
+
+    unsigned long startTime = millis();
+    while (frameInterval_ == 0 && millis() - startTime < RAZOR_RATE_TIMEOUT)
+    {
+        if (available()) {
+            decodeMessage();
+        }
+    }
+
+    // Accept anything within 10% of the target rate
+    float rate = getFrameRate();
+    return (frameInterval_ != 0) && 
+           (10 * rate >= 9 * (float) frameRate) &&
+           (10 * rate <= 11 * (float) frameRate);
 }
 
 
 bool RazorAHRS::available()
 {
-    // We require at least 32 bytes of data waiting at the serial port,
-    // so that no matter where in the message we start decoding,
-    // we can recover yaw, pitch, and roll.
-    return razorSerial_.available() > 32;
+    requestFrame();
+
+    // Pull in everything waiting at the serial port so that the
+    // newest complete frame is the one which gets decoded
+    while (razorSerial_.available())
+    {
+        char c = razorSerial_.read();
+
+        if (framePosition_ < RAZOR_HEADER_LENGTH) {
+            // Look for the "YPR:" header which starts each frame
+            if (c == "YPR:"[framePosition_]) {
+                byteArray_[framePosition_] = c;
+                ++framePosition_;
+            } else if (c == 'Y') {
+                byteArray_[0] = c;
+                framePosition_ = 1;
+            } else {
+                framePosition_ = 0;
+            }
+            continue;
+        }
+
+        byteArray_[framePosition_] = c;
+        ++framePosition_;
+
+        if (framePosition_ == RAZOR_FRAME_LENGTH) {
+            memcpy(frameData_, byteArray_ + RAZOR_HEADER_LENGTH, 
+                   RAZOR_FRAME_LENGTH - RAZOR_HEADER_LENGTH);
+            framePosition_ = 0;
+            frameReady_ = true;
+            timeFrame();
+        }
+    }
+
+    return frameReady_;
 }
 
 
 bool RazorAHRS::decodeMessage()
 {
-    // If we don't have enough data, don't even bother
+    // If we don't have a complete frame, don't even bother
     if (not available()) {
         return false;
     }
 
-    for (uint16_t i = 0; i < 32; ++i)
-    {
-        byteArray_[i] = razorSerial_.read();
-    }
-
-    // Find the start of the message, pull out the bytes for
-    // the yaw, pitch and roll components of the message
-    for (uint16_t i = 0; i < 32; ++i)
+    // Pull out the bytes for the yaw, pitch and roll 
+    // components of the message
+    for (uint8_t i = 0; i < 4; ++i)
     {
-      if (startYPR(i))
-      {
-        yaw_.asBytes[0] = byteArray_[i+4];
-        yaw_.asBytes[1] = byteArray_[i+5];
-        yaw_.asBytes[2] = byteArray_[i+6];
-        yaw_.asBytes[3] = byteArray_[i+7];
-        
-        pitch_.asBytes[0] = byteArray_[i+8];
-        pitch_.asBytes[1] = byteArray_[i+9];
-        pitch_.asBytes[2] = byteArray_[i+10];
-        pitch_.asBytes[3] = byteArray_[i+11];
-        
-        roll_.asBytes[0] = byteArray_[i+12];
-        roll_.asBytes[1] = byteArray_[i+13];
-        roll_.asBytes[2] = byteArray_[i+14];
-        roll_.asBytes[3] = byteArray_[i+15];
-        break;
-      }
+        yaw_.asBytes[i] = frameData_[i];
+        pitch_.asBytes[i] = frameData_[4 + i];
+        roll_.asBytes[i] = frameData_[8 + i];
     }
 
+    frameReady_ = false;
     return true;
 }
 
 
-bool RazorAHRS::startYPR(uint16_t index)
-{
-    bool checkOne = byteArray_[index] == 'Y';
-    bool checkTwo = byteArray_[index+1] == 'P';
-    bool checkThree = byteArray_[index+2] == 'R';
-    bool checkFour = byteArray_[index+3] == ':';
-
-    return checkOne && checkTwo && checkThree && checkFour;
-}
-
-
 float RazorAHRS::getYaw()
 {
     return yaw_.asFloat;
@@ -95,3 +142,64 @@ float RazorAHRS::getRoll()
 {
     return roll_.asFloat;
 }
+
+
+float RazorAHRS::getFrameRate()
+{
+    if (frameInterval_ == 0) {
+        return 0.0;
+    }
+
+    return 1000000.0 / frameInterval_;
+}
+
+
+void RazorAHRS::requestFrame()
+{
+    if (requestInterval_ == 0) {
+        return;
+    }
+
+    unsigned long now = micros();
+    if (now - lastRequestTime_ >= requestInterval_) {
+        razorSerial_.write("#f");
+
+        // Keep to the schedule, unless we have fallen a whole
+        // interval behind, in which case start again from now
+        lastRequestTime_ += requestInterval_;
+        if (now - lastRequestTime_ >= requestInterval_) {
+            lastRequestTime_ = now;
+        }
+    }
+}
+
+
+void RazorAHRS::timeFrame()
+{
+    unsigned long now = micros();
+
+    if (!windowOpen_) {
+        windowStart_ = now;
+        windowFrames_ = 0;
+        windowOpen_ = true;
+        return;
+    }
+
+    // Averaging over a window rather than timing single frames keeps
+    // the measurement honest when several frames are read at once
+    ++windowFrames_;
+    if (now - windowStart_ >= RAZOR_RATE_WINDOW) {
+        frameInterval_ = (now - windowStart_) / windowFrames_;
+        windowStart_ = now;
+        windowFrames_ = 0;
+    }
+}
+
+
+void RazorAHRS::resetFrames()
+{
+    framePosition_ = 0;
+    frameReady_ = false;
+    windowOpen_ = false;
+    frameInterval_ = 0;
+}
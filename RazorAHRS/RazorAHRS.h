@@ -12,6 +12,20 @@
 #include "pins_arduino.h"  // for digitalPinToBitMask, etc
 #endif
 
+// Baud rate and streaming output rate (frames per second) of the
+// Razor firmware. The firmware streams one frame every 20 ms.
+#define RAZOR_DEFAULT_BAUD 57600
+#define RAZOR_STREAM_RATE 50
+
+// A binary frame is "YPR:" followed by the yaw, pitch and roll floats
+#define RAZOR_FRAME_LENGTH 16
+#define RAZOR_HEADER_LENGTH 4
+
+// Length of the window used to measure the frame rate (microseconds),
+// and how long begin() waits for the first measurement (milliseconds)
+#define RAZOR_RATE_WINDOW 250000UL
+#define RAZOR_RATE_TIMEOUT 1000UL
+
 
 class RazorAHRS 
 {
@@ -20,8 +34,30 @@ class RazorAHRS
         // Serial port used to communicate with the Razor
         HardwareSerial& razorSerial_;
         
-        // Byte array used to store values read from the Razor
-        char byteArray_[32];
+        // Byte array used to store the frame being read from the Razor
+        char byteArray_[RAZOR_FRAME_LENGTH];
+
+        // Data of the last complete frame, kept apart from byteArray_ so
+        // the next frame can be read in before this one is decoded
+        char frameData_[RAZOR_FRAME_LENGTH - RAZOR_HEADER_LENGTH];
+
+        // Number of bytes of the current frame received so far, and
+        // whether a complete frame is waiting to be decoded
+        uint8_t framePosition_;
+        bool frameReady_;
+
+        // Time between "#f" frame requests when the Razor is polled 
+        // rather than streaming (microseconds, zero when streaming)
+        unsigned long requestInterval_;
+        unsigned long lastRequestTime_;
+
+        // Frame rate measurement: the start of the current window, the
+        // number of frames received since then, and the average time 
+        // between frames over the last complete window (microseconds)
+        unsigned long windowStart_;
+        uint16_t windowFrames_;
+        bool windowOpen_;
+        unsigned long frameInterval_;
 
         // Union which converts the yaw bytes into a float 
         union {
@@ -47,14 +83,19 @@ class RazorAHRS
         // Constructor for the class
         RazorAHRS(HardwareSerial& razorSerial);
 
-        // Initializes the Razor, prepares it for communication
-        void begin();
+        // Initializes the Razor, prepares it for communication. The baud
+        // rate must match the one the Razor firmware was built with. Frame
+        // rates below RAZOR_STREAM_RATE are reached by polling the Razor,
+        // higher rates need firmware built with a shorter output interval.
+        // Returns whether the measured frame rate reached the target.
+        bool begin(unsigned long baud = RAZOR_DEFAULT_BAUD, 
+                   uint16_t frameRate = RAZOR_STREAM_RATE);
 
         // Checks if there is a yaw-pitch-roll message waiting to be read
         bool available();
 
-        // Reads the bytes from the serial port, decodes them into yaw,
-        // pitch, and roll values. Returns whether or not decoding succeeded
+        // Decodes the last frame read from the Razor into yaw, pitch, 
+        // and roll values. Returns whether or not decoding succeeded
         bool decodeMessage();
 
         // Returns the yaw last decoded from the Razor
@@ -66,14 +107,24 @@ class RazorAHRS
         // Returns the roll last decoded from the Razor
         float getRoll();
 
+        // Returns the measured rate at which frames arrive from the
+        // Razor (frames per second), or zero if it is not yet known
+        float getFrameRate();
+
     private:
 
-        // Determine if the yaw-pitch-roll message starts from
-        // the given index
-        bool startYPR(uint16_t index);
+        // Sends a frame request to the Razor if it is being polled
+        // and the request interval has passed
+        void requestFrame();
+
+        // Updates the frame rate measurement with a newly arrived frame
+        void timeFrame();
+
+        // Discards any partially received frame and rate measurement
+        void resetFrames();
 
 };
 
 
 
-#endif // RAZOR_AHRS_H
\ No newline at end of file
+#endif // RAZOR_AHRS_H
@@ -0,0 +1,282 @@
+// Written by Andrew Donelick
+// adonelick@hmc.edu
+
+
+/*
+ * A version of RelayModule for relay pins which are known when the
+ * sketch is compiled, given as template parameters:
+ *
+ *     FastRelayModule<22, 23, 24, 25> relays;
+ *
+ * The port and bit of every pin are worked out by the compiler, so
+ * switchRelays() writes the port registers directly: one masked
+ * read-modify-write per port used, all with interrupts off, so every
+ * relay on a port changes in the same cycle (and relays on different
+ * ports a cycle or two apart). digitalWrite() looks each pin up in
+ * tables in flash and saves and restores the interrupt state, for every
+ * relay.
+ *
+ * As with RelayModule, relays are on when their pin is LOW. Pin tables
+ * are included for the ATmega328P (Uno) and ATmega1280/2560 (Mega).
+ */
+
+
+#ifndef FAST_RELAY_MODULE_H
+#define FAST_RELAY_MODULE_H 1
+
+#if ARDUINO >= 100
+#include "Arduino.h"       // for delayMicroseconds, digitalPinToBitMask, etc
+#else
+#include "WProgram.h"      // for delayMicroseconds
+#include "pins_arduino.h"  // for digitalPinToBitMask, etc
+#endif
+
+#include <avr/io.h>
+#include <util/atomic.h>
+
+// Ports are numbered by letter (A is 0, B is 1, ... L is 11), and each
+// pin is stored as (port << 3) | bit
+#define RELAY_PORTS 12
+#define RELAY_PIN(port, bit) ((((port) - 'A') << 3) | (bit))
+
+#if defined(__AVR_ATmega1280__) || defined(__AVR_ATmega2560__)
+
+constexpr uint8_t relayPinTable[] = {
+    RELAY_PIN('E', 0), RELAY_PIN('E', 1), RELAY_PIN('E', 4), RELAY_PIN('E', 5),  //  0 -  3
+    RELAY_PIN('G', 5), RELAY_PIN('E', 3), RELAY_PIN('H', 3), RELAY_PIN('H', 4),  //  4 -  7
+    RELAY_PIN('H', 5), RELAY_PIN('H', 6), RELAY_PIN('B', 4), RELAY_PIN('B', 5),  //  8 - 11
+    RELAY_PIN('B', 6), RELAY_PIN('B', 7), RELAY_PIN('J', 1), RELAY_PIN('J', 0),  // 12 - 15
+    RELAY_PIN('H', 1), RELAY_PIN('H', 0), RELAY_PIN('D', 3), RELAY_PIN('D', 2),  // 16 - 19
+    RELAY_PIN('D', 1), RELAY_PIN('D', 0), RELAY_PIN('A', 0), RELAY_PIN('A', 1),  // 20 - 23
+    RELAY_PIN('A', 2), RELAY_PIN('A', 3), RELAY_PIN('A', 4), RELAY_PIN('A', 5),  // 24 - 27
+    RELAY_PIN('A', 6), RELAY_PIN('A', 7), RELAY_PIN('C', 7), RELAY_PIN('C', 6),  // 28 - 31
+    RELAY_PIN('C', 5), RELAY_PIN('C', 4), RELAY_PIN('C', 3), RELAY_PIN('C', 2),  // 32 - 35
+    RELAY_PIN('C', 1), RELAY_PIN('C', 0), RELAY_PIN('D', 7), RELAY_PIN('G', 2),  // 36 - 39
+    RELAY_PIN('G', 1), RELAY_PIN('G', 0), RELAY_PIN('L', 7), RELAY_PIN('L', 6),  // 40 - 43
+    RELAY_PIN('L', 5), RELAY_PIN('L', 4), RELAY_PIN('L', 3), RELAY_PIN('L', 2),  // 44 - 47
+    RELAY_PIN('L', 1), RELAY_PIN('L', 0), RELAY_PIN('B', 3), RELAY_PIN('B', 2),  // 48 - 51
+    RELAY_PIN('B', 1), RELAY_PIN('B', 0), RELAY_PIN('F', 0), RELAY_PIN('F', 1),  // 52 - 55
+    RELAY_PIN('F', 2), RELAY_PIN('F', 3), RELAY_PIN('F', 4), RELAY_PIN('F', 5),  // 56 - 59
+    RELAY_PIN('F', 6), RELAY_PIN('F', 7), RELAY_PIN('K', 0), RELAY_PIN('K', 1),  // 60 - 63
+    RELAY_PIN('K', 2), RELAY_PIN('K', 3), RELAY_PIN('K', 4), RELAY_PIN('K', 5),  // 64 - 67
+    RELAY_PIN('K', 6), RELAY_PIN('K', 7)                                         // 68 - 69
+};
+
+#elif defined(__AVR_ATmega328P__) || defined(__AVR_ATmega168__)
+
+constexpr uint8_t relayPinTable[] = {
+    RELAY_PIN('D', 0), RELAY_PIN('D', 1), RELAY_PIN('D', 2), RELAY_PIN('D', 3),  //  0 -  3
+    RELAY_PIN('D', 4), RELAY_PIN('D', 5), RELAY_PIN('D', 6), RELAY_PIN('D', 7),  //  4 -  7
+    RELAY_PIN('B', 0), RELAY_PIN('B', 1), RELAY_PIN('B', 2), RELAY_PIN('B', 3),  //  8 - 11
+    RELAY_PIN('B', 4), RELAY_PIN('B', 5), RELAY_PIN('C', 0), RELAY_PIN('C', 1),  // 12 - 15
+    RELAY_PIN('C', 2), RELAY_PIN('C', 3), RELAY_PIN('C', 4), RELAY_PIN('C', 5)   // 16 - 19
+};
+
+#else
+#error "FastRelayModule has no pin table for this board, use RelayModule"
+#endif
+
+
+// Port and bit mask of a pin, and the mask of the pins on a port of the
+// relays whose pins are listed (the first relay's pin first)
+constexpr uint8_t relayPort(uint8_t pin)
+{
+    return relayPinTable[pin] >> 3;
+}
+
+constexpr uint8_t relayBit(uint8_t pin)
+{
+    return 1 << (relayPinTable[pin] & 0x07);
+}
+
+constexpr uint8_t relayPortMask(uint8_t)
+{
+    return 0;
+}
+
+template <typename... Pins>
+constexpr uint8_t relayPortMask(uint8_t port, uint8_t pin, Pins... pins)
+{
+    return (relayPort(pin) == port ? relayBit(pin) : 0) | relayPortMask(port, pins...);
+}
+
+// The same values as constants, so the table itself is never read when
+// the sketch runs
+template <uint8_t Pin>
+struct RelayPin
+{
+    static constexpr uint8_t port = relayPort(Pin);
+    static constexpr uint8_t bit = relayBit(Pin);
+};
+
+template <uint8_t Port, uint8_t... Pins>
+struct RelayPortMask
+{
+    static constexpr uint8_t value = relayPortMask(Port, Pins...);
+};
+
+// Selects the code for one port when the sketch is compiled
+template <uint8_t Port>
+struct RelayPortTag {};
+
+
+template <uint8_t... Pins>
+class FastRelayModule
+{
+    static_assert(sizeof...(Pins) <= 16, "FastRelayModule has at most 16 relays");
+
+    private:
+
+        unsigned int relayStates_;
+
+    public:
+
+        FastRelayModule() : relayStates_(0) {}
+
+        // Set the pins used to control the relays as outputs,
+        // intially turn all of the relays off
+        void begin()
+        {
+            ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+            {
+                setupPorts(RelayPortTag<0>());
+            }
+            relayStates_ = 0;
+        }
+
+        // Turn a specific relay on or off
+        void switchRelayOn(int relayIndex)
+        {
+            switchRelays(relayStates_ | (1U << relayIndex));
+        }
+
+        void switchRelayOff(int relayIndex)
+        {
+            switchRelays(relayStates_ & ~(1U << relayIndex));
+        }
+
+        // Switch all of the relays on/off using a relayState integer
+        // (the bits of the integer control whether a relay is on or off)
+        void switchRelays(unsigned int relayStates)
+        {
+            ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+            {
+                writePorts(relayStates, RelayPortTag<0>());
+            }
+
+            relayStates_ = relayStates & ((1UL << sizeof...(Pins)) - 1);
+        }
+
+        // Get the current relay state integer which represents the current
+        // state of all used relays
+        unsigned int getRelayStates()
+        {
+            return relayStates_;
+        }
+
+        // Determine whether a specific relay is on or off
+        bool getRelayState(int relayIndex)
+        {
+            return relayStates_ & (1U << relayIndex);
+        }
+
+    private:
+
+        // One masked read-modify-write for each port with relays on it,
+        // from the first port to the last. The ports and masks are 
+        // constants, so ports without relays produce no code.
+        template <uint8_t Port>
+        static void setupPorts(RelayPortTag<Port>)
+        {
+            const uint8_t mask = RelayPortMask<Port, Pins...>::value;
+            if (mask)
+            {
+                portRegister<Port>() |= mask;
+                directionRegister<Port>() |= mask;
+            }
+            setupPorts(RelayPortTag<Port + 1>());
+        }
+
+        static void setupPorts(RelayPortTag<RELAY_PORTS>) {}
+
+        template <uint8_t Port>
+        static void writePorts(unsigned int relayStates, RelayPortTag<Port>)
+        {
+            const uint8_t mask = RelayPortMask<Port, Pins...>::value;
+            if (mask) 
+            {
+                const uint8_t low = portLow<Port, 0, Pins...>(relayStates);
+                portRegister<Port>() = (portRegister<Port>() | mask) & ~low;
+            }
+            writePorts(relayStates, RelayPortTag<Port + 1>());
+        }
+
+        static void writePorts(unsigned int, RelayPortTag<RELAY_PORTS>) {}
+
+        // Bits of a port to drive LOW (the relays on it which are on)
+        template <uint8_t Port, uint8_t Index>
+        static uint8_t portLow(unsigned int)
+        {
+            return 0;
+        }
+
+        template <uint8_t Port, uint8_t Index, uint8_t Pin, uint8_t... Rest>
+        static uint8_t portLow(unsigned int relayStates)
+        {
+            return ((RelayPin<Pin>::port == Port && (relayStates & (1U << Index))) ? RelayPin<Pin>::bit : 0) |
+                   portLow<Port, Index + 1, Rest...>(relayStates);
+        }
+
+        // Output and direction registers of a port (the port is a 
+        // template parameter, so only its own register is left)
+        template <uint8_t Port>
+        static volatile uint8_t& portRegister()
+        {
+            switch (Port)
+            {
+#ifdef PORTA
+                case 'A' - 'A': return PORTA;
+#endif
+                case 'B' - 'A': return PORTB;
+                case 'C' - 'A': return PORTC;
+                case 'D' - 'A': return PORTD;
+#ifdef PORTE
+                case 'E' - 'A': return PORTE;
+                case 'F' - 'A': return PORTF;
+                case 'G' - 'A': return PORTG;
+                case 'H' - 'A': return PORTH;
+                case 'J' - 'A': return PORTJ;
+                case 'K' - 'A': return PORTK;
+                case 'L' - 'A': return PORTL;
+#endif
+                default: return PORTB;
+            }
+        }
+
+        template <uint8_t Port>
+        static volatile uint8_t& directionRegister()
+        {
+            switch (Port)
+            {
+#ifdef DDRA
+                case 'A' - 'A': return DDRA;
+#endif
+                case 'B' - 'A': return DDRB;
+                case 'C' - 'A': return DDRC;
+                case 'D' - 'A': return DDRD;
+#ifdef DDRE
+                case 'E' - 'A': return DDRE;
+                case 'F' - 'A': return DDRF;
+                case 'G' - 'A': return DDRG;
+                case 'H' - 'A': return DDRH;
+                case 'J' - 'A': return DDRJ;
+                case 'K' - 'A': return DDRK;
+                case 'L' - 'A': return DDRL;
+#endif
+                default: return DDRB;
+            }
+        }
+};
+
+
+#endif // FastRelayModule included
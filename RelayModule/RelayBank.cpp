@@ -0,0 +1,194 @@
+// Written by Andrew Donelick
+// adonelick@hmc.edu
+
+#include "RelayBank.h"
+#include <SPI.h>
+#include <util/atomic.h>
+
+RelayBank::RelayBank(uint8_t latchPin, uint8_t numRegisters, bool activeLow)
+    : numRegisters_(numRegisters < RELAY_BANK_MAX_REGISTERS ? numRegisters : RELAY_BANK_MAX_REGISTERS),
+      activeLow_(activeLow),
+      useSpi_(true),
+      dataPin_(0),
+      clockPin_(0),
+      latchPin_(latchPin),
+      updateTime_(0)
+{
+    clearRelays();
+}
+
+
+RelayBank::RelayBank(uint8_t dataPin, uint8_t clockPin, uint8_t latchPin, 
+                     uint8_t numRegisters, bool activeLow)
+    : numRegisters_(numRegisters < RELAY_BANK_MAX_REGISTERS ? numRegisters : RELAY_BANK_MAX_REGISTERS),
+      activeLow_(activeLow),
+      useSpi_(false),
+      dataPin_(dataPin),
+      clockPin_(clockPin),
+      latchPin_(latchPin),
+      updateTime_(0)
+{
+    clearRelays();
+}
+
+
+void RelayBank::begin()
+{
+    pinMode(latchPin_, OUTPUT);
+    digitalWrite(latchPin_, LOW);
+    latchPort_ = portOutputRegister(digitalPinToPort(latchPin_));
+    latchMask_ = digitalPinToBitMask(latchPin_);
+
+    if (useSpi_)
+    {
+        SPI.begin();
+    }
+    else
+    {
+        pinMode(dataPin_, OUTPUT);
+        pinMode(clockPin_, OUTPUT);
+        digitalWrite(clockPin_, LOW);
+        dataPort_ = portOutputRegister(digitalPinToPort(dataPin_));
+        dataMask_ = digitalPinToBitMask(dataPin_);
+        clockPort_ = portOutputRegister(digitalPinToPort(clockPin_));
+        clockMask_ = digitalPinToBitMask(clockPin_);
+    }
+
+    clearRelays();
+    update();
+}
+
+
+void RelayBank::setRelay(int relayIndex, bool on)
+{
+    if (relayIndex < 0 || relayIndex >= getNumRelays())
+        return;
+
+    if (on) {
+        relayStates_[relayIndex >> 3] |= 1 << (relayIndex & 0x07);
+    } else {
+        relayStates_[relayIndex >> 3] &= ~(1 << (relayIndex & 0x07));
+    }
+}
+
+
+void RelayBank::setRelays(int firstRelay, unsigned int relayStates)
+{
+    for (int i = 0; i < 16; ++i)
+    {
+        setRelay(firstRelay + i, relayStates & (1U << i));
+    }
+}
+
+
+void RelayBank::clearRelays()
+{
+    for (uint8_t i = 0; i < RELAY_BANK_MAX_REGISTERS; ++i)
+    {
+        relayStates_[i] = 0;
+    }
+}
+
+
+void RelayBank::update()
+{
+    unsigned long start = micros();
+
+    if (useSpi_) {
+        SPI.beginTransaction(SPISettings(RELAY_BANK_SPI_CLOCK, MSBFIRST, SPI_MODE0));
+    }
+
+    // The last register in the chain takes the first byte sent
+    uint8_t invert = activeLow_ ? 0xFF : 0x00;
+    for (int i = numRegisters_ - 1; i >= 0; --i)
+    {
+        shiftOut(relayStates_[i] ^ invert);
+    }
+
+    if (useSpi_) {
+        SPI.endTransaction();
+    }
+
+    // Latch every register at once
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        *latchPort_ |= latchMask_;
+        *latchPort_ &= ~latchMask_;
+    }
+
+    updateTime_ = micros() - start;
+}
+
+
+void RelayBank::switchRelayOn(int relayIndex)
+{
+    setRelay(relayIndex, true);
+    update();
+}
+
+
+void RelayBank::switchRelayOff(int relayIndex)
+{
+    setRelay(relayIndex, false);
+    update();
+}
+
+
+bool RelayBank::getRelayState(int relayIndex)
+{
+    if (relayIndex < 0 || relayIndex >= getNumRelays())
+        return false;
+
+    return relayStates_[relayIndex >> 3] & (1 << (relayIndex & 0x07));
+}
+
+
+unsigned int RelayBank::getRelayStates(int firstRelay)
+{
+    unsigned int states = 0;
+    for (int i = 0; i < 16; ++i)
+    {
+        if (getRelayState(firstRelay + i)) {
+            states |= 1U << i;
+        }
+    }
+    return states;
+}
+
+
+int RelayBank::getNumRelays()
+{
+    return 8 * numRegisters_;
+}
+
+
+unsigned long RelayBank::getUpdateTime()
+{
+    return updateTime_;
+}
+
+
+void RelayBank::shiftOut(uint8_t value)
+{
+    if (useSpi_)
+    {
+        SPI.transfer(value);
+        return;
+    }
+
+    // The pins are written through their port registers, since 
+    // digitalWrite() would take several times as long for each bit
+    for (uint8_t bit = 0x80; bit != 0; bit >>= 1)
+    {
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+        {
+            if (value & bit) {
+                *dataPort_ |= dataMask_;
+            } else {
+                *dataPort_ &= ~dataMask_;
+            }
+            *clockPort_ |= clockMask_;
+            *clockPort_ &= ~clockMask_;
+        }
+    }
+}
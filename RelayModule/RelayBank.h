@@ -0,0 +1,105 @@
+// Written by Andrew Donelick
+// adonelick@hmc.edu
+
+
+/*
+ * This class drives a large bank of relays through a chain of 
+ * 74HC595 shift registers, eight relays per register. Relay states are
+ * kept packed in bits, and changing them only changes the bits in RAM:
+ * update() then shifts the whole bank out in one burst and latches it,
+ * so every relay in the bank changes at the same moment.
+ *
+ * The registers are driven either with the hardware SPI (MOSI to the
+ * first register's data input, SCK to every clock input, and any pin to
+ * the latch inputs), or by bit banging three pins. Other SPI devices 
+ * such as the SD card can share the bus, since the outputs only change
+ * when the latch is pulsed.
+ *
+ * Relay 0 is output Q0 of the first register in the chain (the one 
+ * connected to the Arduino), relay 8 is Q0 of the second, and so on.
+ */
+
+
+#ifndef RELAY_BANK_H
+#define RELAY_BANK_H 1
+
+#if ARDUINO >= 100
+#include "Arduino.h"       // for delayMicroseconds, digitalPinToBitMask, etc
+#else
+#include "WProgram.h"      // for delayMicroseconds
+#include "pins_arduino.h"  // for digitalPinToBitMask, etc
+#endif
+
+// Most shift registers in a chain (eight relays each)
+#define RELAY_BANK_MAX_REGISTERS 8
+
+// SPI clock for the shift registers (they are good for much more)
+#define RELAY_BANK_SPI_CLOCK 4000000
+
+class RelayBank
+{
+    private:
+
+        // Relay states, one bit per relay, and the number of registers
+        uint8_t relayStates_[RELAY_BANK_MAX_REGISTERS];
+        uint8_t numRegisters_;
+        bool activeLow_;
+
+        // Pins, and their port registers and masks for bit banging
+        bool useSpi_;
+        uint8_t dataPin_;
+        uint8_t clockPin_;
+        uint8_t latchPin_;
+        volatile uint8_t* dataPort_;
+        volatile uint8_t* clockPort_;
+        volatile uint8_t* latchPort_;
+        uint8_t dataMask_;
+        uint8_t clockMask_;
+        uint8_t latchMask_;
+
+        // Time taken by the last update (microseconds)
+        unsigned long updateTime_;
+
+    public:
+
+        // A chain driven with the hardware SPI, with its latch on latchPin
+        RelayBank(uint8_t latchPin, uint8_t numRegisters, bool activeLow = true);
+
+        // A chain driven by bit banging the data, clock and latch pins
+        RelayBank(uint8_t dataPin, uint8_t clockPin, uint8_t latchPin, 
+                  uint8_t numRegisters, bool activeLow = true);
+
+        // Sets up the pins, and turns all of the relays off
+        void begin();
+
+        // Change relay states in RAM, to be sent by the next update()
+        void setRelay(int relayIndex, bool on);
+        void setRelays(int firstRelay, unsigned int relayStates);
+        void clearRelays();
+
+        // Shifts out the whole bank and latches it
+        void update();
+
+        // Turn a specific relay on or off straight away
+        void switchRelayOn(int relayIndex);
+        void switchRelayOff(int relayIndex);
+
+        // Determine whether a specific relay is on or off, and get the 
+        // states of the 16 relays from firstRelay
+        bool getRelayState(int relayIndex);
+        unsigned int getRelayStates(int firstRelay = 0);
+
+        // Number of relays in the bank
+        int getNumRelays();
+
+        // Time taken by the last update() (microseconds)
+        unsigned long getUpdateTime();
+
+    private:
+
+        // Sends one byte to the chain, most significant bit first
+        void shiftOut(uint8_t value);
+};
+
+
+#endif // RelayBank included
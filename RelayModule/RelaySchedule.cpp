@@ -0,0 +1,355 @@
+// Written by Andrew Donelick
+// adonelick@hmc.edu
+
+#include "RelaySchedule.h"
+#include <util/atomic.h>
+
+RelaySchedule* volatile RelaySchedule::active_ = 0;
+bool RelaySchedule::installed_ = false;
+
+
+RelaySchedule::RelaySchedule(RelayModule& relays)
+    : relays_(relays),
+      numSteps_(0),
+      numActions_(0),
+      overflows_(0),
+      startTime_(0),
+      started_(false),
+      maxLateness_(0),
+      dropped_(0)
+{
+    // Nothing else to do here...
+}
+
+
+bool RelaySchedule::begin()
+{
+    // Without the interrupts the first overflow would reset the board
+    if (!installed_) {
+        return false;
+    }
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        active_ = this;
+        overflows_ = 0;
+
+        // Normal mode, F_CPU / 256, overflow interrupt on
+        TCCR1A = 0;
+        TCCR1B = _BV(CS12);
+        TCNT1 = 0;
+        TIFR1 = _BV(TOV1) | _BV(OCF1A);
+        TIMSK1 = _BV(TOIE1);
+    }
+
+    return true;
+}
+
+
+void RelaySchedule::end()
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        TIMSK1 = 0;
+        TCCR1B = 0;
+        active_ = 0;
+    }
+}
+
+
+bool RelaySchedule::addStep(uint8_t relay, bool on, unsigned long offset, 
+                            unsigned int duration, uint8_t event)
+{
+    if (relay >= NUM_RELAYS || event >= RELAY_EVENTS || 
+        offset > RELAY_SCHEDULE_MAX_OFFSET || 
+        duration > RELAY_SCHEDULE_MAX_OFFSET - offset || 
+        numSteps_ >= RELAY_SCHEDULE_STEPS || 
+        (duration > 0 ? 2 : 1) > queueRoom()) {
+        return false;
+    }
+
+    Step step;
+    step.relay = relay;
+    step.on = on;
+    step.event = event;
+    step.offset = offset;
+    step.duration = duration;
+
+    // Steps timed from a start which has already happened go straight
+    // on to the queue
+    if (event == RELAY_AT_START && started_) 
+    {
+        queueStep(step, startTime_);
+        return true;
+    }
+
+    steps_[numSteps_++] = step;
+    return true;
+}
+
+
+bool RelaySchedule::load(const uint16_t data[], uint16_t length)
+{
+    if (length % RELAY_STEP_WORDS != 0 || 
+        numSteps_ + length / RELAY_STEP_WORDS > RELAY_SCHEDULE_STEPS) {
+        return false;
+    }
+
+    // Check every step before adding any
+    uint8_t switches = 0;
+    for (uint16_t i = 0; i < length; i += RELAY_STEP_WORDS)
+    {
+        unsigned long offset = ((unsigned long) data[i + 1] << 16) | data[i + 2];
+        if ((data[i] & 0x0F) >= NUM_RELAYS || 
+            offset > RELAY_SCHEDULE_MAX_OFFSET || 
+            data[i + 3] > RELAY_SCHEDULE_MAX_OFFSET - offset) {
+            return false;
+        }
+        switches += (data[i + 3] > 0) ? 2 : 1;
+    }
+
+    if (switches > queueRoom()) {
+        return false;
+    }
+
+    for (uint16_t i = 0; i < length; i += RELAY_STEP_WORDS)
+    {
+        unsigned long offset = ((unsigned long) data[i + 1] << 16) | data[i + 2];
+        addStep(data[i] & 0x0F, data[i] & 0x10, offset, data[i + 3], 
+                (data[i] >> 5) & 0x07);
+    }
+
+    return true;
+}
+
+
+void RelaySchedule::start()
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        startTime_ = ticks();
+    }
+
+    started_ = true;
+    trigger(RELAY_AT_START);
+}
+
+
+void RelaySchedule::trigger(uint8_t event)
+{
+    uint32_t now;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        now = ticks();
+    }
+
+    // Queue the steps for this event, and keep the rest in order
+    uint8_t kept = 0;
+    for (uint8_t i = 0; i < numSteps_; ++i)
+    {
+        if (steps_[i].event == event) {
+            queueStep(steps_[i], now);
+        } else {
+            steps_[kept++] = steps_[i];
+        }
+    }
+    numSteps_ = kept;
+}
+
+
+void RelaySchedule::clear()
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        numActions_ = 0;
+        TIMSK1 &= ~_BV(OCIE1A);
+    }
+
+    numSteps_ = 0;
+    started_ = false;
+}
+
+
+uint8_t RelaySchedule::getPendingSteps()
+{
+    return numSteps_;
+}
+
+
+uint8_t RelaySchedule::getPendingActions()
+{
+    return numActions_;
+}
+
+
+unsigned long RelaySchedule::getMaxLateness()
+{
+    uint16_t lateness;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        lateness = maxLateness_;
+    }
+    return (unsigned long) lateness * RELAY_SCHEDULE_TICK;
+}
+
+
+uint8_t RelaySchedule::getDropped()
+{
+    return dropped_;
+}
+
+
+void RelaySchedule::handleOverflow()
+{
+    ++overflows_;
+    runDue();
+}
+
+
+void RelaySchedule::handleCompare()
+{
+    runDue();
+}
+
+
+void RelaySchedule::handleOverflowInterrupt()
+{
+    if (active_) {
+        active_->handleOverflow();
+    }
+}
+
+
+void RelaySchedule::handleCompareInterrupt()
+{
+    if (active_) {
+        active_->handleCompare();
+    }
+}
+
+
+bool RelaySchedule::installInterrupts()
+{
+    installed_ = true;
+    return true;
+}
+
+
+uint32_t RelaySchedule::ticks()
+{
+    uint16_t count = TCNT1;
+    uint16_t overflows = overflows_;
+
+    // An overflow which has not been handled yet
+    if ((TIFR1 & _BV(TOV1)) && count < 0x8000) {
+        ++overflows;
+    }
+
+    return ((uint32_t) overflows << 16) | count;
+}
+
+
+uint32_t RelaySchedule::msToTicks(unsigned long ms)
+{
+    // Ticks per 4 ms is a whole number for the usual clocks, and keeps
+    // the product within 32 bits
+    const uint32_t perFour = F_CPU / 64000;
+    return (ms / 4) * perFour + (ms % 4) * perFour / 4;
+}
+
+
+uint8_t RelaySchedule::queueRoom()
+{
+    // Switches only leave the queue from the interrupts, so this can
+    // only be too small
+    uint8_t used = numActions_;
+    for (uint8_t i = 0; i < numSteps_; ++i) {
+        used += (steps_[i].duration > 0) ? 2 : 1;
+    }
+    return RELAY_SCHEDULE_ACTIONS - used;
+}
+
+
+void RelaySchedule::queueStep(const Step& step, uint32_t base)
+{
+    uint32_t time = base + msToTicks(step.offset);
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        queueAction(time, step.relay, step.on);
+        if (step.duration > 0) {
+            queueAction(time + msToTicks(step.duration), step.relay, !step.on);
+        }
+        runDue();
+    }
+}
+
+
+void RelaySchedule::queueAction(uint32_t time, uint8_t relay, bool on)
+{
+    if (numActions_ >= RELAY_SCHEDULE_ACTIONS) 
+    {
+        ++dropped_;
+        return;
+    }
+
+    // Insert in time order, after any switches at the same time
+    uint8_t i = numActions_;
+    while (i > 0 && (int32_t) (time - actions_[i - 1].time) < 0)
+    {
+        actions_[i] = actions_[i - 1];
+        --i;
+    }
+
+    actions_[i].time = time;
+    actions_[i].relay = relay;
+    actions_[i].on = on;
+    ++numActions_;
+}
+
+
+void RelaySchedule::runDue()
+{
+    while (numActions_ > 0)
+    {
+        uint32_t now = ticks();
+        int32_t wait = actions_[0].time - now;
+
+        if (wait <= 0)
+        {
+            if (actions_[0].on) {
+                relays_.switchRelayOn(actions_[0].relay);
+            } else {
+                relays_.switchRelayOff(actions_[0].relay);
+            }
+
+            if ((uint32_t) -wait > maxLateness_) {
+                maxLateness_ = (-wait > 0xFFFF) ? 0xFFFF : -wait;
+            }
+
+            --numActions_;
+            for (uint8_t i = 0; i < numActions_; ++i) {
+                actions_[i] = actions_[i + 1];
+            }
+            continue;
+        }
+
+        // Due before the next overflow: the compare interrupt switches 
+        // it, otherwise the overflow interrupt looks again
+        if ((actions_[0].time >> 16) != (now >> 16)) {
+            break;
+        }
+
+        OCR1A = actions_[0].time & 0xFFFF;
+        TIFR1 = _BV(OCF1A);
+        TIMSK1 |= _BV(OCIE1A);
+
+        // If the timer passed the compare value while it was being set,
+        // the interrupt would not come until the next overflow
+        if ((int32_t) (actions_[0].time - ticks()) > 0) {
+            return;
+        }
+    }
+
+    TIMSK1 &= ~_BV(OCIE1A);
+}
@@ -0,0 +1,202 @@
+// Written by Andrew Donelick
+// adonelick@hmc.edu
+
+
+/*
+ * Runs a schedule of relay switches for a RelayModule, so a whole 
+ * sequence (payload power up, cutdown, ...) can be sent in one command
+ * instead of one SWITCH_RELAYS command per change. Each step turns a
+ * relay on or off a number of milliseconds after an event, and can 
+ * switch it back after a duration:
+ *
+ *     schedule.addStep(2, true, 3600000UL, 10000);  // relay 2 on at
+ *                                                   // T+3600 s for 10 s
+ *
+ * Event 0 (RELAY_AT_START) is the start of the schedule, set by 
+ * start(). Events 1 to 7 are up to the sketch (reaching an altitude,
+ * losing the radio, ...), and happen when it calls trigger(). Once its
+ * event has happened a step is queued, and Timer1 switches the relay 
+ * from its interrupts at the right time, to within RELAY_SCHEDULE_TICK 
+ * (16 us at 16 MHz), rather than whenever loop() next gets to it.
+ *
+ * The schedule uses Timer1, so the Servo library and analogWrite() on
+ * the Timer1 pins cannot be used alongside it. Times are limited to 
+ * RELAY_SCHEDULE_MAX_OFFSET after their event.
+ *
+ * The Timer1 interrupts are only defined in sketches which use the 
+ * schedule, so that other sketches using RelayModule can use Timer1 
+ * themselves. Those sketches expand this once, outside any function:
+ *
+ *     RELAY_SCHEDULE_INTERRUPTS()
+ *
+ * Without it begin() returns false and the timer is left alone.
+ *
+ * In a SCHEDULE_RELAYS command every step is RELAY_STEP_WORDS words:
+ *
+ *     word 0: bits 0 - 3 relay, bit 4 on (1) or off (0), 
+ *             bits 5 - 7 event
+ *     word 1: high word of the time after the event (ms)
+ *     word 2: low word of the time after the event (ms)
+ *     word 3: duration (ms), 0 leaves the relay switched
+ */
+
+
+#ifndef RELAY_SCHEDULE_H
+#define RELAY_SCHEDULE_H 1
+
+#if ARDUINO >= 100
+#include "Arduino.h"       // for delayMicroseconds, digitalPinToBitMask, etc
+#else
+#include "WProgram.h"      // for delayMicroseconds
+#include "pins_arduino.h"  // for digitalPinToBitMask, etc
+#endif
+
+#include "RelayModule.h"
+#include <avr/interrupt.h>
+
+// Defines the Timer1 interrupts for the schedule, and tells the 
+// schedule they are there
+#define RELAY_SCHEDULE_INTERRUPTS() \
+    ISR(TIMER1_OVF_vect) { RelaySchedule::handleOverflowInterrupt(); } \
+    ISR(TIMER1_COMPA_vect) { RelaySchedule::handleCompareInterrupt(); } \
+    static const bool relayScheduleInterrupts = RelaySchedule::installInterrupts();
+
+// Steps waiting for their event, and switches queued on the timer (a 
+// step with a duration queues two)
+#define RELAY_SCHEDULE_STEPS 16
+#define RELAY_SCHEDULE_ACTIONS (2 * RELAY_SCHEDULE_STEPS)
+
+// Events steps can be tied to
+#define RELAY_AT_START 0
+#define RELAY_EVENTS 8
+
+// Words per step in a SCHEDULE_RELAYS command
+#define RELAY_STEP_WORDS 4
+
+// Timer1 runs at F_CPU / 256, RELAY_SCHEDULE_TICK is one tick in us.
+// The queue keeps 32 bit tick times, so times must be less than half 
+// of their range (about 9 hours at 16 MHz).
+#define RELAY_SCHEDULE_TICK (256 / (F_CPU / 1000000UL))
+#define RELAY_SCHEDULE_MAX_OFFSET 32400000UL
+
+
+class RelaySchedule
+{
+    private:
+
+        // A step waiting for its event
+        struct Step
+        {
+            uint8_t relay;
+            bool on;
+            uint8_t event;
+            unsigned long offset;
+            unsigned int duration;
+        };
+
+        // A switch queued on the timer, at a time in timer ticks
+        struct Action
+        {
+            uint32_t time;
+            uint8_t relay;
+            bool on;
+        };
+
+        RelayModule& relays_;
+
+        Step steps_[RELAY_SCHEDULE_STEPS];
+        uint8_t numSteps_;
+
+        // Queued switches, soonest first
+        Action actions_[RELAY_SCHEDULE_ACTIONS];
+        volatile uint8_t numActions_;
+
+        // High word of the timer's tick count
+        volatile uint16_t overflows_;
+
+        // Tick count when the schedule was started
+        uint32_t startTime_;
+        bool started_;
+
+        // Latest a switch has happened after its time (ticks), and the
+        // switches dropped because the queue was full
+        volatile uint16_t maxLateness_;
+        uint8_t dropped_;
+
+        // The schedule the Timer1 interrupts report to, and whether the
+        // sketch has defined the interrupts
+        static RelaySchedule* volatile active_;
+        static bool installed_;
+
+    public:
+
+        RelaySchedule(RelayModule& relays);
+
+        // Starts Timer1 (the schedule itself waits for start()). Returns
+        // false if the sketch has not defined the interrupts.
+        bool begin();
+
+        // Stops Timer1, leaving the relays as they are
+        void end();
+
+        // Adds a step. Returns false if the step is not valid or there 
+        // is no room for it (in the steps, or for its switches in the 
+        // queue).
+        bool addStep(uint8_t relay, bool on, unsigned long offset, 
+                     unsigned int duration = 0, uint8_t event = RELAY_AT_START);
+
+        // Adds the steps of a SCHEDULE_RELAYS command. Either all of the
+        // steps are added, or (if any is not valid, or they do not fit)
+        // none are and false is returned.
+        bool load(const uint16_t data[], uint16_t length);
+
+        // Starts the schedule: steps tied to RELAY_AT_START are timed 
+        // from now, including any added later
+        void start();
+
+        // Queues the steps waiting for an event, timed from now
+        void trigger(uint8_t event);
+
+        // Removes every step and queued switch
+        void clear();
+
+        // Steps waiting for their event, and switches still queued
+        uint8_t getPendingSteps();
+        uint8_t getPendingActions();
+
+        // Latest a switch has happened after its scheduled time (us),
+        // and the number of switches which did not fit in the queue
+        unsigned long getMaxLateness();
+        uint8_t getDropped();
+
+        // Called from the Timer1 interrupts
+        void handleOverflow();
+        void handleCompare();
+
+        // Used by RELAY_SCHEDULE_INTERRUPTS()
+        static void handleOverflowInterrupt();
+        static void handleCompareInterrupt();
+        static bool installInterrupts();
+
+    private:
+
+        // Tick count now, call with interrupts off
+        uint32_t ticks();
+
+        // Converts milliseconds to timer ticks
+        uint32_t msToTicks(unsigned long ms);
+
+        // Room left in the queue once every waiting step is queued
+        uint8_t queueRoom();
+
+        // Queues the switches of a step, timed from the given tick count
+        void queueStep(const Step& step, uint32_t base);
+        void queueAction(uint32_t time, uint8_t relay, bool on);
+
+        // Switches every relay which is due, then sets the compare 
+        // interrupt for the next one. Call with interrupts off.
+        void runDue();
+};
+
+
+#endif // RelaySchedule included
@@ -0,0 +1,163 @@
+// Written by Andrew Donelick
+// adonelick@hmc.edu
+
+#include "SensorScheduler.h"
+
+SensorScheduler::SensorScheduler()
+    : numTasks_(0),
+      missedDeadlines_(0)
+{
+    // Nothing else to do here...
+}
+
+
+int8_t SensorScheduler::addSensor(SensorStep step, unsigned long period, unsigned int cost)
+{
+    // A period of 0 would never let a deadline pass
+    if (numTasks_ >= MAX_SENSOR_TASKS || period == 0) {
+        return -1;
+    }
+
+    SensorTask& task = tasks_[numTasks_];
+    task.step = step;
+    task.period = period;
+    task.cost = cost;
+    task.release = millis();
+    task.value = 0;
+    task.timestamp = 0;
+    task.valid = false;
+    task.missed = 0;
+    task.maxCost = 0;
+
+    return numTasks_++;
+}
+
+
+void SensorScheduler::run(unsigned long budget)
+{
+    unsigned long now = millis();
+    unsigned long spent = 0;
+    bool stepped[MAX_SENSOR_TASKS];
+
+    for (uint8_t i = 0; i < numTasks_; ++i) {
+        checkDeadline(i, now);
+        stepped[i] = false;
+    }
+
+    while (true)
+    {
+        // Pick the due sensor with the earliest deadline
+        int8_t next = -1;
+        for (uint8_t i = 0; i < numTasks_; ++i)
+        {
+            if (stepped[i] || !due(i, now)) {
+                continue;
+            }
+
+            if (next < 0 || (long) (tasks_[i].release + tasks_[i].period 
+                                    - tasks_[next].release - tasks_[next].period) < 0) {
+                next = i;
+            }
+        }
+
+        if (next < 0) {
+            return;
+        }
+
+        // Leave the rest for the next loop if this step does not fit
+        SensorTask& task = tasks_[next];
+        if (spent > 0 && spent + task.cost > budget) {
+            return;
+        }
+
+        unsigned long startTime = micros();
+        long value;
+        bool sampled = task.step(value);
+        unsigned long elapsed = micros() - startTime;
+
+        if (elapsed > task.maxCost) {
+            task.maxCost = elapsed;
+        }
+        // Charge the time the step really took, so one which overruns
+        // its cost uses up the budget
+        spent += elapsed;
+        stepped[next] = true;
+
+        if (sampled)
+        {
+            task.value = value;
+            task.timestamp = millis();
+            task.valid = true;
+
+            // The next sample is due one period after this one was; if
+            // that is already past, start it now rather than catch up
+            task.release += task.period;
+            if ((long) (task.timestamp - task.release) > 0) {
+                task.release = task.timestamp;
+            }
+        }
+    }
+}
+
+
+long SensorScheduler::getValue(uint8_t sensor)
+{
+    return tasks_[sensor].value;
+}
+
+
+unsigned long SensorScheduler::getTimestamp(uint8_t sensor)
+{
+    return tasks_[sensor].timestamp;
+}
+
+
+unsigned long SensorScheduler::getAge(uint8_t sensor)
+{
+    return millis() - tasks_[sensor].timestamp;
+}
+
+
+bool SensorScheduler::isStale(uint8_t sensor)
+{
+    return !tasks_[sensor].valid || 
+           getAge(sensor) > STALE_PERIODS * tasks_[sensor].period;
+}
+
+
+unsigned int SensorScheduler::getMissedDeadlines(uint8_t sensor)
+{
+    return tasks_[sensor].missed;
+}
+
+
+unsigned int SensorScheduler::getMissedDeadlines()
+{
+    return missedDeadlines_;
+}
+
+
+unsigned long SensorScheduler::getMaxCost(uint8_t sensor)
+{
+    return tasks_[sensor].maxCost;
+}
+
+
+bool SensorScheduler::due(uint8_t sensor, unsigned long now)
+{
+    return (long) (now - tasks_[sensor].release) >= 0;
+}
+
+
+void SensorScheduler::checkDeadline(uint8_t sensor, unsigned long now)
+{
+    // A sample is due by the time the next one is released. Each 
+    // period which passes without one is a missed deadline.
+    SensorTask& task = tasks_[sensor];
+    while ((long) (now - task.release) >= (long) task.period)
+    {
+        task.release += task.period;
+        ++task.missed;
+        ++missedDeadlines_;
+    }
+}
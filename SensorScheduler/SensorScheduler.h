@@ -0,0 +1,105 @@
+// Written by Andrew Donelick
+// adonelick@hmc.edu
+
+/*
+ * This class schedules the reading of the balloon's sensors. Each 
+ * sensor is registered with a non-blocking step function, the period
+ * at which it should produce a sample, and an estimate of how long 
+ * one step takes. Every call to run() steps the sensors which are due,
+ * earliest deadline first, until the time budget for that loop 
+ * iteration is used up. The latest sample from each sensor is kept in
+ * a table along with the time it was taken, and a sensor which has not
+ * produced a sample by the end of its period counts a missed deadline.
+ */
+
+#ifndef SENSOR_SCHEDULER_H
+#define SENSOR_SCHEDULER_H 1
+
+#if ARDUINO >= 100
+#include "Arduino.h"       // for delayMicroseconds, digitalPinToBitMask, etc
+#else
+#include "WProgram.h"      // for delayMicroseconds
+#include "pins_arduino.h"  // for digitalPinToBitMask, etc
+#endif
+
+#define MAX_SENSOR_TASKS 8
+
+// A sample is stale once it is older than this many periods
+#define STALE_PERIODS 2
+
+// A step function advances a sensor's measurement without blocking.
+// It returns true, and sets value, when a new sample is ready.
+typedef bool (*SensorStep)(long& value);
+
+
+class SensorScheduler
+{
+    private:
+
+        struct SensorTask
+        {
+            SensorStep step;
+
+            // Target sample period (ms) and cost of one step (us)
+            unsigned long period;
+            unsigned int cost;
+
+            // When the current sample was due to start (ms)
+            unsigned long release;
+
+            // Latest sample, the time it was taken (ms), and whether
+            // there has been a sample yet
+            long value;
+            unsigned long timestamp;
+            bool valid;
+
+            // Deadlines missed, and the longest step measured (us)
+            unsigned int missed;
+            unsigned long maxCost;
+        };
+
+        SensorTask tasks_[MAX_SENSOR_TASKS];
+        uint8_t numTasks_;
+        unsigned int missedDeadlines_;
+
+    public:
+
+        SensorScheduler();
+
+        // Registers a sensor to be sampled every period milliseconds, 
+        // with each step taking about cost microseconds. Returns the
+        // sensor's index in the sample table, or -1 if it is full or
+        // the period is 0.
+        int8_t addSensor(SensorStep step, unsigned long period, unsigned int cost);
+
+        // Steps the sensors which are due, spending no more than about
+        // budget microseconds (at least one step is always taken)
+        void run(unsigned long budget);
+
+        // Latest sample from a sensor, and when it was taken (ms)
+        long getValue(uint8_t sensor);
+        unsigned long getTimestamp(uint8_t sensor);
+
+        // How old the latest sample is (ms), and whether it is stale
+        // (older than STALE_PERIODS periods, or never taken)
+        unsigned long getAge(uint8_t sensor);
+        bool isStale(uint8_t sensor);
+
+        // Deadlines missed by one sensor, and by all of them
+        unsigned int getMissedDeadlines(uint8_t sensor);
+        unsigned int getMissedDeadlines();
+
+        // Longest step measured for a sensor (us)
+        unsigned long getMaxCost(uint8_t sensor);
+
+    private:
+
+        // Whether a sensor's current sample has been released
+        bool due(uint8_t sensor, unsigned long now);
+
+        // Counts any deadlines a sensor has let pass
+        void checkDeadline(uint8_t sensor, unsigned long now);
+};
+
+
+#endif // SENSOR_SCHEDULER_H
@@ -0,0 +1,99 @@
+// Sensor Scheduler Example (Sensor polling)
+// Written by Andrew Donelick
+// <adonelick@hmc.edu>
+
+// Include the sensor libraries
+#include <OneWire.h>
+#include <Wire.h>
+#include <Sensors.h>
+#include <RazorAHRS.h>
+#include <SensorScheduler.h>
+
+// The analog sensors are sampled in the background by the ADC interrupt
+ANALOG_SAMPLER_INTERRUPT()
+
+// Time allowed for reading sensors in each loop (microseconds)
+#define SENSOR_BUDGET 2000
+
+Sensors sensors;
+RazorAHRS razor(Serial1);
+SensorScheduler scheduler;
+
+int8_t pressure;
+int8_t externalTemp;
+int8_t internalTemp;
+int8_t humidity;
+int8_t yaw;
+
+// Step functions for each of the sensors. Each one does a little
+// work and returns true when it has a new sample.
+
+bool stepPressure(long& value)
+{
+  if (!sensors.bmp085Poll()) {
+    return false;
+  }
+  value = sensors.bmp085Pressure();
+  return true;
+}
+
+bool stepExternalTemp(long& value)
+{
+  if (!sensors.digitalTemperaturePoll()) {
+    return false;
+  }
+  value = sensors.getDigitalTemperatureCenti(EXTERNAL_TEMP);
+  return true;
+}
+
+bool stepInternalTemp(long& value)
+{
+  value = sensors.getAnalogTemperatureCenti(INTERNAL_TEMP);
+  return true;
+}
+
+bool stepHumidity(long& value)
+{
+  value = sensors.getAnalogHumidityCenti(ANALOG_HUMIDITY);
+  return true;
+}
+
+bool stepYaw(long& value)
+{
+  if (!razor.decodeMessage()) {
+    return false;
+  }
+  value = 100 * razor.getYaw();
+  return true;
+}
+
+void setup()
+{
+  Serial.begin(9600);
+  sensors.begin();
+  sensors.beginAnalogSampling();
+  razor.begin();
+
+  // Period (ms) and cost of one step (us) for each sensor
+  pressure = scheduler.addSensor(stepPressure, 100, 1200);
+  externalTemp = scheduler.addSensor(stepExternalTemp, 2000, 12000);
+  internalTemp = scheduler.addSensor(stepInternalTemp, 1000, 200);
+  humidity = scheduler.addSensor(stepHumidity, 1000, 200);
+  yaw = scheduler.addSensor(stepYaw, 20, 300);
+}
+
+void loop()
+{
+  scheduler.run(SENSOR_BUDGET);
+
+  if (!scheduler.isStale(pressure)) {
+    Serial.print(scheduler.getValue(pressure));
+    Serial.print(' ');
+    Serial.println(scheduler.getAge(pressure));
+  }
+
+  if (scheduler.getMissedDeadlines() > 0) {
+    Serial.print("Missed deadlines: ");
+    Serial.println(scheduler.getMissedDeadlines());
+  }
+}
@@ -0,0 +1,118 @@
+// Written by Andrew Donelick
+// adonelick@hmc.edu
+
+/*
+ * Altitude (cm) of the 1976 U.S. Standard Atmosphere at the pressures
+ * 2^n * (1 + j/32) Pa, for n = 7 ... 16 and j = 0 ... 31, followed by
+ * the altitude at 2^17 Pa. This covers roughly -2200 m to 46000 m.
+ * Within each segment altitude is interpolated linearly in pressure,
+ * which stays within a metre of the exact formula over the whole range.
+ */
+
+#ifndef ALTITUDE_TABLE_H
+#define ALTITUDE_TABLE_H 1
+
+#ifdef ARDUINO
+#include <avr/pgmspace.h>
+#else
+// Built on a host computer by extras/altitude_check.cpp
+#define PROGMEM
+#define pgm_read_dword(address) (*(address))
+#endif
+
+// The table starts at 2^ALTITUDE_MIN_OCTAVE Pa, and each octave of
+// pressure is split into 2^ALTITUDE_SEGMENT_BITS segments
+#define ALTITUDE_MIN_OCTAVE 7
+#define ALTITUDE_MAX_OCTAVE 17
+#define ALTITUDE_SEGMENT_BITS 5
+
+const long altitudeTable[] PROGMEM = {
+    // 128 - 256 Pa
+    4587102L, 4563039L, 4539752L, 4517195L, 4495324L, 4474102L, 4453491L, 4433458L,
+    4413974L, 4395010L, 4376540L, 4358540L, 4340987L, 4323860L, 4307141L, 4290810L,
+    4274850L, 4259247L, 4243984L, 4229048L, 4214426L, 4200105L, 4186073L, 4172319L,
+    4158834L, 4145607L, 4132628L, 4119889L, 4107382L, 4095098L, 4083030L, 4071171L,
+    // 256 - 512 Pa
+    4059514L, 4036780L, 4014779L, 3993468L, 3972805L, 3952754L, 3933282L, 3914356L,
+    3895948L, 3878031L, 3860581L, 3843575L, 3826991L, 3810810L, 3795014L, 3779585L,
+    3764507L, 3749765L, 3735346L, 3721234L, 3707420L, 3693889L, 3680632L, 3667639L,
+    3654898L, 3642401L, 3630139L, 3618104L, 3606287L, 3594682L, 3583280L, 3572076L,
+    // 512 - 1024 Pa
+    3561063L, 3539584L, 3518799L, 3498664L, 3479143L, 3460199L, 3441802L, 3423921L,
+    3406530L, 3389602L, 3373116L, 3357049L, 3341381L, 3326094L, 3311170L, 3296593L,
+    3282348L, 3268421L, 3254797L, 3241465L, 3228413L, 3215630L, 3203106L, 3190826L,
+    3178774L, 3166942L, 3155322L, 3143906L, 3132688L, 3121660L, 3110817L, 3100153L,
+    // 1024 - 2048 Pa
+    3089661L, 3069174L, 3049317L, 3030052L, 3011346L, 2993166L, 2975486L, 2958278L,
+    2941519L, 2925185L, 2909256L, 2893713L, 2878538L, 2863713L, 2849224L, 2835056L,
+    2821194L, 2807627L, 2794341L, 2781326L, 2768572L, 2756067L, 2743803L, 2731770L,
+    2719961L, 2708366L, 2696979L, 2685793L, 2674800L, 2663994L, 2653368L, 2642918L,
+    // 2048 - 4096 Pa
+    2632637L, 2612562L, 2593104L, 2574225L, 2555895L, 2538081L, 2520755L, 2503893L,
+    2487470L, 2471465L, 2455856L, 2440625L, 2425754L, 2411228L, 2397029L, 2383145L,
+    2369562L, 2356267L, 2343249L, 2330495L, 2317997L, 2305743L, 2293725L, 2281934L,
+    2270362L, 2259001L, 2247842L, 2236881L, 2226108L, 2215519L, 2205107L, 2194867L,
+    // 4096 - 8192 Pa
+    2184792L, 2165120L, 2146053L, 2127554L, 2109591L, 2092135L, 2075158L, 2058634L,
+    2042541L, 2026857L, 2011562L, 1996636L, 1982057L, 1967806L, 1953868L, 1940229L,
+    1926878L, 1913802L, 1900990L, 1888432L, 1876118L, 1864038L, 1852185L, 1840548L,
+    1829122L, 1817897L, 1806868L, 1796027L, 1785369L, 1774887L, 1764575L, 1754428L,
+    // 8192 - 16384 Pa
+    1744441L, 1724927L, 1705995L, 1687612L, 1669748L, 1652372L, 1635460L, 1618988L,
+    1602932L, 1587273L, 1571991L, 1557069L, 1542490L, 1528238L, 1514300L, 1500662L,
+    1487311L, 1474235L, 1461423L, 1448865L, 1436551L, 1424471L, 1412617L, 1400981L,
+    1389554L, 1378330L, 1367301L, 1356460L, 1345801L, 1335319L, 1325007L, 1314861L,
+    // 16384 - 32768 Pa
+    1304874L, 1285359L, 1266428L, 1248045L, 1230180L, 1212805L, 1195893L, 1179420L,
+    1163364L, 1147705L, 1132424L, 1117501L, 1102922L, 1088652L, 1074637L, 1060866L,
+    1047331L, 1034023L, 1020932L, 1008052L, 995375L, 982893L, 970601L, 958492L,
+    946560L, 934799L, 923204L, 911769L, 900491L, 889364L, 878383L, 867545L,
+    // 32768 - 65536 Pa
+    856846L, 835847L, 815357L, 795349L, 775799L, 756683L, 737982L, 719675L,
+    701744L, 684173L, 666945L, 650046L, 633463L, 617182L, 601191L, 585480L,
+    570037L, 554852L, 539916L, 525220L, 510755L, 496514L, 482489L, 468673L,
+    455059L, 441640L, 428410L, 415364L, 402496L, 389800L, 377272L, 364906L,
+    // 65536 - 131072 Pa
+    352698L, 328739L, 305360L, 282532L, 260225L, 238415L, 217078L, 196190L,
+    175731L, 155683L, 136027L, 116746L, 97824L, 79248L, 61003L, 43077L,
+    25457L, 8131L, -8910L, -25678L, -42182L, -58430L, -74432L, -90196L,
+    -105730L, -121040L, -136135L, -151020L, -165703L, -180188L, -194483L, -208592L,
+    // 131072 Pa
+    -222521L
+};
+
+
+/*
+ * Convert a pressure (Pa) into a standard atmosphere altitude (cm).
+ * The pressure's octave is found from its highest set bit, and the 
+ * rest of it picks a segment of the octave and the position within it.
+ */
+inline long interpolateAltitude(long pressure)
+{
+    if (pressure < (1L << ALTITUDE_MIN_OCTAVE)) {
+        pressure = 1L << ALTITUDE_MIN_OCTAVE;
+    } else if (pressure >= (1L << ALTITUDE_MAX_OCTAVE)) {
+        pressure = (1L << ALTITUDE_MAX_OCTAVE) - 1;
+    }
+
+    // Find the octave the pressure lies in
+    unsigned char octave = ALTITUDE_MAX_OCTAVE - 1;
+    while (!(pressure & (1L << octave))) {
+        --octave;
+    }
+
+    // Split the rest of the pressure into the segment within the
+    // octave, and the position within that segment
+    unsigned char shift = octave - ALTITUDE_SEGMENT_BITS;
+    long offset = pressure - (1L << octave);
+    int index = ((octave - ALTITUDE_MIN_OCTAVE) << ALTITUDE_SEGMENT_BITS) 
+                + (offset >> shift);
+    long fraction = offset & ((1L << shift) - 1);
+
+    long upper = pgm_read_dword(&altitudeTable[index]);
+    long lower = pgm_read_dword(&altitudeTable[index + 1]);
+
+    return upper - (((upper - lower) * fraction) >> shift);
+}
+
+#endif // ALTITUDE_TABLE_H
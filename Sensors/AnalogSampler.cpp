@@ -0,0 +1,177 @@
+// Written by Andrew Donelick
+// adonelick@hmc.edu
+
+#include "AnalogSampler.h"
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+
+AnalogSampler* volatile AnalogSampler::active_ = 0;
+bool AnalogSampler::installed_ = false;
+
+
+void AnalogSampler::handleInterrupt()
+{
+    if (active_) {
+        active_->handleConversion(ADC);
+    }
+}
+
+
+bool AnalogSampler::installInterrupt()
+{
+    installed_ = true;
+    return true;
+}
+
+
+AnalogSampler::AnalogSampler()
+    : numChannels_(0),
+      current_(0),
+      rounds_(0),
+      running_(false),
+      windowIndex_(0),
+      primed_(false)
+{
+    // Nothing else to do here...
+}
+
+
+bool AnalogSampler::addChannel(uint8_t pin)
+{
+    if (running_ || numChannels_ >= ANALOG_CHANNELS) {
+        return false;
+    }
+
+    pins_[numChannels_] = pin;
+    channels_[numChannels_] = (pin >= A0) ? pin - A0 : pin;
+    ++numChannels_;
+    return true;
+}
+
+
+bool AnalogSampler::begin()
+{
+    // Without the interrupt the first conversion would never be handled
+    if (numChannels_ == 0 || !installed_) {
+        return false;
+    }
+
+    for (uint8_t i = 0; i < numChannels_; ++i) {
+        accumulators_[i] = 0;
+        values_[i] = 0;
+    }
+
+    current_ = 0;
+    rounds_ = 0;
+    windowIndex_ = 0;
+    primed_ = false;
+    running_ = true;
+    active_ = this;
+
+    startConversion(channels_[0]);
+    return true;
+}
+
+
+void AnalogSampler::end()
+{
+    // Turn off the interrupt, but leave the ADC enabled for analogRead()
+    ADCSRA &= ~_BV(ADIE);
+    running_ = false;
+    active_ = 0;
+}
+
+
+bool AnalogSampler::samples(uint8_t pin)
+{
+    return running_ && findPin(pin) >= 0;
+}
+
+
+uint16_t AnalogSampler::read(uint8_t pin)
+{
+    int8_t index = findPin(pin);
+    if (index < 0) {
+        return 0;
+    }
+
+    uint16_t value;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        value = values_[index];
+    }
+    return value;
+}
+
+
+void AnalogSampler::handleConversion(uint16_t result)
+{
+    accumulators_[current_] += result;
+
+    ++current_;
+    if (current_ == numChannels_)
+    {
+        current_ = 0;
+        ++rounds_;
+        if (rounds_ == ANALOG_DECIMATION) {
+            updateWindows();
+            rounds_ = 0;
+        }
+    }
+
+    startConversion(channels_[current_]);
+}
+
+
+void AnalogSampler::startConversion(uint8_t channel)
+{
+    // Converting one channel at a time and starting the next conversion
+    // here keeps every result tied to the channel selected for it
+#if defined(MUX5)
+    ADCSRB = (ADCSRB & ~_BV(MUX5)) | (((channel >> 3) & 0x01) << MUX5);
+#endif
+    ADMUX = _BV(REFS0) | (channel & 0x07);
+    ADCSRA = _BV(ADEN) | _BV(ADSC) | _BV(ADIE) | _BV(ADPS2) | _BV(ADPS1) | _BV(ADPS0);
+}
+
+
+void AnalogSampler::updateWindows()
+{
+    for (uint8_t i = 0; i < numChannels_; ++i)
+    {
+        uint16_t sample = accumulators_[i];
+        accumulators_[i] = 0;
+
+        if (!primed_) {
+            // Start every window full of the first sample, so the
+            // output is meaningful straight away
+            for (uint8_t j = 0; j < ANALOG_WINDOW; ++j) {
+                window_[i][j] = sample;
+            }
+            windowSum_[i] = (uint32_t) sample * ANALOG_WINDOW;
+        } else {
+            windowSum_[i] += sample;
+            windowSum_[i] -= window_[i][windowIndex_];
+            window_[i][windowIndex_] = sample;
+        }
+
+        // windowSum_ holds ANALOG_DECIMATION * ANALOG_WINDOW samples,
+        // scale it to ANALOG_SCALE times their mean
+        values_[i] = (windowSum_[i] >> ANALOG_WINDOW_BITS) 
+                     / (ANALOG_DECIMATION / ANALOG_SCALE);
+    }
+
+    primed_ = true;
+    windowIndex_ = (windowIndex_ + 1) % ANALOG_WINDOW;
+}
+
+
+int8_t AnalogSampler::findPin(uint8_t pin)
+{
+    for (uint8_t i = 0; i < numChannels_; ++i) {
+        if (pins_[i] == pin) {
+            return i;
+        }
+    }
+    return -1;
+}
@@ -0,0 +1,132 @@
+// Written by Andrew Donelick
+// adonelick@hmc.edu
+
+/*
+ * This class samples a set of analog channels in the background. Each
+ * time the ADC finishes a conversion its interrupt stores the result, 
+ * switches to the next channel and starts another conversion, so the
+ * channels are sampled round robin without the sketch waiting on 
+ * analogRead(). Every channel is filtered in two stages: 
+ * ANALOG_DECIMATION samples are summed into one decimated sample, and
+ * the last ANALOG_WINDOW decimated samples are kept in a ring buffer
+ * with a running sum (a moving average). Reading a channel only 
+ * fetches the current filter output.
+ *
+ * While the sampler is running analogRead() must not be used.
+ *
+ * The ADC interrupt is only defined in sketches which sample in the 
+ * background, so that other sketches (and other libraries) can use it.
+ * Those sketches expand this once, outside any function:
+ *
+ *     ANALOG_SAMPLER_INTERRUPT()
+ *
+ * Without it begin() returns false and nothing is sampled.
+ */
+
+#ifndef ANALOG_SAMPLER_H
+#define ANALOG_SAMPLER_H 1
+
+#if ARDUINO >= 100
+#include "Arduino.h"       // for delayMicroseconds, digitalPinToBitMask, etc
+#else
+#include "WProgram.h"      // for delayMicroseconds
+#include "pins_arduino.h"  // for digitalPinToBitMask, etc
+#endif
+
+#include <avr/interrupt.h>
+
+// Defines the ADC interrupt for the sampler, and tells the sampler it
+// is there
+#define ANALOG_SAMPLER_INTERRUPT() \
+    ISR(ADC_vect) { AnalogSampler::handleInterrupt(); } \
+    static const bool analogSamplerInterrupt = AnalogSampler::installInterrupt();
+
+// Maximum number of channels which can be sampled
+#define ANALOG_CHANNELS 3
+
+// Filter lengths. ANALOG_DECIMATION must be a multiple of ANALOG_SCALE
+// and no more than 64 (so the decimated sums fit in 16 bits), and 
+// ANALOG_WINDOW must be 2^ANALOG_WINDOW_BITS.
+#define ANALOG_DECIMATION 16
+#define ANALOG_WINDOW 8
+#define ANALOG_WINDOW_BITS 3
+
+// Filter outputs are in sixteenths of an ADC count
+#define ANALOG_SCALE 16
+
+
+class AnalogSampler
+{
+    private:
+
+        // Analog pins being sampled, and their ADC channel numbers
+        uint8_t pins_[ANALOG_CHANNELS];
+        uint8_t channels_[ANALOG_CHANNELS];
+        uint8_t numChannels_;
+
+        // Channel currently being converted, and the number of complete
+        // rounds summed into the decimation accumulators so far
+        uint8_t current_;
+        uint8_t rounds_;
+        bool running_;
+
+        // Decimation stage for each channel
+        uint16_t accumulators_[ANALOG_CHANNELS];
+
+        // Moving average stage for each channel
+        uint16_t window_[ANALOG_CHANNELS][ANALOG_WINDOW];
+        uint32_t windowSum_[ANALOG_CHANNELS];
+        uint8_t windowIndex_;
+        bool primed_;
+
+        // Latest filter output for each channel
+        volatile uint16_t values_[ANALOG_CHANNELS];
+
+        // The sampler the ADC interrupt reports to, and whether the
+        // sketch has defined the interrupt
+        static AnalogSampler* volatile active_;
+        static bool installed_;
+
+    public:
+
+        AnalogSampler();
+
+        // Adds an analog pin to the set of channels sampled. Returns
+        // false if there is no room, or the sampler is already running.
+        bool addChannel(uint8_t pin);
+
+        // Starts sampling in the background. Returns false if there are
+        // no channels, or the sketch has not defined the interrupt.
+        bool begin();
+
+        // Stops sampling, analogRead() may be used again afterwards
+        void end();
+
+        // Whether the sampler is running and samples the given pin
+        bool samples(uint8_t pin);
+
+        // Returns the filtered value of the given pin, in sixteenths of
+        // an ADC count (0 if the pin is not sampled)
+        uint16_t read(uint8_t pin);
+
+        // Called from the ADC interrupt with each conversion result
+        void handleConversion(uint16_t result);
+
+        // Used by ANALOG_SAMPLER_INTERRUPT()
+        static void handleInterrupt();
+        static bool installInterrupt();
+
+    private:
+
+        // Points the ADC at a channel and starts a conversion
+        void startConversion(uint8_t channel);
+
+        // Moves the decimated samples into the moving averages
+        void updateWindows();
+
+        // Finds which of the sampled channels belongs to a pin
+        int8_t findPin(uint8_t pin);
+};
+
+
+#endif // ANALOG_SAMPLER_H
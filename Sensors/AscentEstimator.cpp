@@ -0,0 +1,224 @@
+// Written by Andrew Donelick
+// adonelick@hmc.edu
+
+#include "AscentEstimator.h"
+
+AscentEstimator::AscentEstimator(Sensors& sensors)
+    : sensors_(sensors)
+{
+    reset();
+}
+
+
+void AscentEstimator::reset()
+{
+    started_ = false;
+    lastTime_ = 0;
+    altitude_ = 0;
+    speed_ = 0;
+    phase_ = PHASE_GROUND;
+    launchStart_ = 0;
+    floatStart_ = 0;
+    burstStart_ = 0;
+}
+
+
+uint8_t AscentEstimator::update(long pressure, long temperature, unsigned long time)
+{
+    long standardAltitude = sensors_.pressureToAltitude(pressure);
+    long variance = measurementVariance(pressure);
+
+    if (!started_)
+    {
+        // Start at the first measurement, with no idea of the speed
+        lastStandardAltitude_ = standardAltitude;
+        measuredAltitude_ = standardAltitude << STATE_SHIFT;
+        altitude_ = standardAltitude << STATE_SHIFT;
+        speed_ = 0;
+        p00_ = variance;
+        p01_ = 0;
+        p11_ = INITIAL_SPEED_ERROR * INITIAL_SPEED_ERROR;
+        lastTime_ = time;
+        started_ = true;
+        return EVENT_NONE;
+    }
+
+    // The layer between the two samples is at its middle altitude
+    measuredAltitude_ += correctAltitudeChange(standardAltitude - lastStandardAltitude_,
+                                               (standardAltitude + lastStandardAltitude_) / 2, 
+                                               temperature);
+    lastStandardAltitude_ = standardAltitude;
+
+    long dt = time - lastTime_;
+    if (dt > MAX_SAMPLE_GAP) {
+        dt = MAX_SAMPLE_GAP;
+    }
+    lastTime_ = time;
+
+    predict(dt);
+    correct(measuredAltitude_, variance);
+
+    return detectEvents(time);
+}
+
+
+long AscentEstimator::getAltitude()
+{
+    return (altitude_ + STATE_ROUND) >> STATE_SHIFT;
+}
+
+
+long AscentEstimator::getAscentRate()
+{
+    return (speed_ + STATE_ROUND) >> STATE_SHIFT;
+}
+
+
+uint8_t AscentEstimator::getFlightPhase()
+{
+    return phase_;
+}
+
+
+// The standard atmosphere altitude assumes the standard temperature at
+// each altitude. The real thickness of a layer of air scales with its
+// absolute temperature, so scale the change by T_air / T_standard.
+long AscentEstimator::correctAltitudeChange(long change, long standardAltitude, long temperature)
+{
+    if (temperature <= NO_TEMPERATURE) {
+        return change << STATE_SHIFT;
+    }
+
+    // Standard temperature in hundredths of a kelvin: falling 6.5 K/km
+    // to 11 km, constant to 20 km, rising 1 K/km to 32 km, then 2.8 K/km
+    long km100 = standardAltitude / 1000;    // altitude in units of 10 m
+    long standardTemperature;
+    if (km100 < 1100) {
+        standardTemperature = 28815 - (650 * km100) / 100;
+    } else if (km100 < 2000) {
+        standardTemperature = 21665;
+    } else if (km100 < 3200) {
+        standardTemperature = 21665 + (100 * (km100 - 2000)) / 100;
+    } else {
+        standardTemperature = 22865 + (280 * (km100 - 3200)) / 100;
+    }
+
+    // Keep the fraction of a centimetre too, truncating every sample's
+    // change to whole centimetres would bias the altitude and speed. The
+    // product takes 64 bits once the change is more than about 700 m (a
+    // glitched pressure can do that).
+    int64_t scaled = (int64_t) change * (temperature + 27315);
+    int64_t whole = scaled / standardTemperature;
+    int64_t fraction = scaled % standardTemperature;
+    return (whole << STATE_SHIFT) + (fraction << STATE_SHIFT) / standardTemperature;
+}
+
+
+// The BMP085's pressure noise turns into an altitude noise which grows
+// as the air thins. The slope of the altitude curve gives the scale.
+long AscentEstimator::measurementVariance(long pressure)
+{
+    long slope = (sensors_.pressureToAltitude(pressure - 16) 
+                  - sensors_.pressureToAltitude(pressure + 16)) / 32;
+    long sigma = PRESSURE_NOISE * (slope > 1 ? slope : 1);
+    return sigma * sigma;
+}
+
+
+void AscentEstimator::predict(long dt)
+{
+    if (dt <= 0) {
+        return;
+    }
+
+    // Constant speed model, driven by white acceleration noise
+    int64_t dt2 = (int64_t) dt * dt;
+    int64_t q = ACCELERATION_NOISE * ACCELERATION_NOISE;
+
+    altitude_ += ((int64_t) speed_ * dt) / 1000;
+
+    p00_ += (2000 * (int64_t) p01_ * dt + (int64_t) p11_ * dt2 
+             + q * dt2 * dt2 / 4000000) / 1000000;
+    p01_ += ((int64_t) p11_ * dt * 1000 + q * dt2 * dt / 2000) / 1000000;
+    p11_ += (q * dt2) / 1000000;
+}
+
+
+void AscentEstimator::correct(long altitude, long variance)
+{
+    // Gains in 1/65536 (the speed gain per second)
+    int64_t s = (int64_t) p00_ + variance;
+    int64_t k0 = ((int64_t) p00_ << 16) / s;
+    int64_t k1 = ((int64_t) p01_ << 16) / s;
+
+    // The corrections are rounded rather than truncated, so that
+    // small corrections do not bias the state downwards
+    int64_t innovation = (int64_t) altitude - altitude_;
+    altitude_ += (k0 * innovation + 32768) >> 16;
+    speed_ += (k1 * innovation + 32768) >> 16;
+
+    p11_ -= (k1 * p01_) >> 16;
+    p01_ -= (k0 * p01_) >> 16;
+    p00_ -= (k0 * p00_) >> 16;
+}
+
+
+uint8_t AscentEstimator::detectEvents(unsigned long time)
+{
+    bool launching = held(launchStart_, getAscentRate() > LAUNCH_RATE, time, LAUNCH_TIME);
+    bool floating = held(floatStart_, abs(getAscentRate()) < FLOAT_RATE, time, FLOAT_TIME);
+    bool falling = held(burstStart_, getAscentRate() < BURST_RATE, time, BURST_TIME);
+
+    switch (phase_)
+    {
+        case PHASE_GROUND:
+            if (launching) {
+                phase_ = PHASE_ASCENT;
+                return EVENT_LAUNCH;
+            }
+            break;
+
+        case PHASE_ASCENT:
+            if (falling) {
+                phase_ = PHASE_DESCENT;
+                return EVENT_BURST;
+            } else if (floating) {
+                phase_ = PHASE_FLOAT;
+                return EVENT_FLOAT;
+            }
+            break;
+
+        case PHASE_FLOAT:
+            if (falling) {
+                phase_ = PHASE_DESCENT;
+                return EVENT_BURST;
+            } else if (launching) {
+                // Climbing again (ballast dropped), no new event
+                phase_ = PHASE_ASCENT;
+            }
+            break;
+
+        default:
+            break;
+    }
+
+    return EVENT_NONE;
+}
+
+
+// Tracks how long a condition has held, from the time in 'start'
+// (0 while the condition does not hold)
+bool AscentEstimator::held(unsigned long& start, bool condition, 
+                           unsigned long time, unsigned long duration)
+{
+    if (!condition) {
+        start = 0;
+        return false;
+    }
+
+    if (start == 0) {
+        start = time;
+    }
+
+    return time - start >= duration;
+}
@@ -0,0 +1,134 @@
+// Written by Andrew Donelick
+// adonelick@hmc.edu
+
+/*
+ * This class estimates the altitude and vertical speed of the balloon
+ * from the BMP085 pressure readings, and watches for the launch, the
+ * start of a float, and the burst. Each pressure sample is converted 
+ * into an altitude, corrected for the difference between the outside
+ * air temperature and the standard atmosphere, and fed to a two state
+ * (altitude, vertical speed) Kalman filter. The filter runs entirely 
+ * in integer math: altitudes in cm, speeds in cm/s and times in ms.
+ */
+
+#ifndef ASCENT_ESTIMATOR_H
+#define ASCENT_ESTIMATOR_H 1
+
+#include "Sensors.h"
+
+// Flight phases
+#define PHASE_GROUND 0
+#define PHASE_ASCENT 1
+#define PHASE_FLOAT 2
+#define PHASE_DESCENT 3
+
+// Events returned by update()
+#define EVENT_NONE 0
+#define EVENT_LAUNCH 1
+#define EVENT_FLOAT 2
+#define EVENT_BURST 3
+
+// RMS pressure noise of the BMP085 at OSS = 3 (Pa), and the RMS 
+// vertical acceleration the filter allows for (cm/s^2)
+#define PRESSURE_NOISE 3
+#define ACCELERATION_NOISE 50L
+
+// Initial uncertainty of the vertical speed (cm/s), and the longest
+// gap between samples the filter will predict across (ms)
+#define INITIAL_SPEED_ERROR 500L
+#define MAX_SAMPLE_GAP 5000L
+
+// Event detection: vertical speeds (cm/s) which must hold for a
+// time (ms) before the flight phase changes
+#define LAUNCH_RATE 100
+#define LAUNCH_TIME 10000UL
+#define FLOAT_RATE 50
+#define FLOAT_TIME 120000UL
+#define BURST_RATE -300
+#define BURST_TIME 5000UL
+
+// Fractional bits kept in the filter's altitude and speed
+#define STATE_SHIFT 8
+#define STATE_ROUND (1L << (STATE_SHIFT - 1))
+
+// Temperatures below this (hundredths of a degree C) are treated as
+// missing, and no temperature correction is made
+#define NO_TEMPERATURE -27315L
+
+
+class AscentEstimator
+{
+    private:
+
+        // Used for the pressure to altitude conversion
+        Sensors& sensors_;
+
+        // Whether the filter has been started by a first sample
+        bool started_;
+        unsigned long lastTime_;
+
+        // Standard atmosphere altitude of the last sample (cm), and the
+        // temperature corrected altitude built up from it (cm, with
+        // STATE_SHIFT fractional bits so rounding does not build up)
+        long lastStandardAltitude_;
+        long measuredAltitude_;
+
+        // Filter state (cm, cm/s, both with STATE_SHIFT fractional bits)
+        // and covariance (cm^2, cm^2/s, cm^2/s^2)
+        long altitude_;
+        long speed_;
+        long p00_;
+        long p01_;
+        long p11_;
+
+        // Flight phase, and since when each of the launch, float and
+        // burst conditions has held (0 if it does not currently hold)
+        uint8_t phase_;
+        unsigned long launchStart_;
+        unsigned long floatStart_;
+        unsigned long burstStart_;
+
+    public:
+
+        AscentEstimator(Sensors& sensors);
+
+        // Forgets all samples and returns to the ground phase
+        void reset();
+
+        // Adds a pressure sample (Pa) taken at the given time (ms) with
+        // the outside air temperature (hundredths of a degree C, or
+        // NO_TEMPERATURE). Returns the event this sample triggered.
+        uint8_t update(long pressure, long temperature, unsigned long time);
+
+        // Filtered altitude (cm) and ascent rate (cm/s, negative when
+        // descending)
+        long getAltitude();
+        long getAscentRate();
+
+        // Current flight phase
+        uint8_t getFlightPhase();
+
+    private:
+
+        // Altitude change corrected for the air temperature (cm, with
+        // STATE_SHIFT fractional bits)
+        long correctAltitudeChange(long change, long standardAltitude, long temperature);
+
+        // Measurement variance of an altitude taken at this pressure
+        long measurementVariance(long pressure);
+
+        // Kalman filter prediction and correction steps (the altitude 
+        // with STATE_SHIFT fractional bits)
+        void predict(long dt);
+        void correct(long altitude, long variance);
+
+        // Checks the ascent rate for a change of flight phase
+        uint8_t detectEvents(unsigned long time);
+
+        // Whether a condition has held for the given time
+        bool held(unsigned long& start, bool condition, 
+                  unsigned long time, unsigned long duration);
+};
+
+
+#endif // ASCENT_ESTIMATOR_H
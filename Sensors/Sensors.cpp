@@ -3,24 +3,83 @@
 // adonelick@hmc.edu
 
 #include "Sensors.h"
+#include "AltitudeTable.h"
 
 
 Sensors::Sensors()
-    : externalTemp_(EXTERNAL_TEMP)
+    : externalTemp_(EXTERNAL_TEMP),
+      numDigitalSensors_(0),
+      nextDigitalSensor_(0),
+      digitalState_(ONEWIRE_IDLE),
+      digitalConversionStart_(0),
+      calibrated_(false),
+      bmp085State_(BMP085_IDLE),
+      bmp085ConversionStart_(0),
+      bmp085Temperature_(0),
+      bmp085Pressure_(0),
+      i2cErrors_(0),
+      i2cRecoveries_(0),
+      i2cMaxTime_(0),
+      i2cTransactions_(0)
 {
     OSS = 3;
 }
 
 
-void Sensors::begin()
+bool Sensors::begin()
 {
-    Wire.begin();
-    bmp085Calibration();
+    beginI2C();
+
+    // The calibration is needed for every pressure, so try it a few
+    // times before giving up
+    for (uint8_t i = 0; i < BMP085_CALIBRATION_TRIES && !bmp085Calibration(); ++i) {
+        delay(BMP085_CALIBRATION_RETRY_TIME);
+    }
+
+    findDigitalSensors();
+    return calibrated_;
+}
+
+/*
+ * Read the temperature and pressure from the BMP085 and 
+ * return the standard atmosphere altitude in centimeters
+ * (0 if the BMP085 calibration cannot be read)
+ */
+long Sensors::getAltitude()
+{
+    if (!calibrated_ && !bmp085Calibration()) {
+        return 0;
+    }
+
+    bmp085GetTemperature();
+    return pressureToAltitude(bmp085GetPressure());
+}
+
+
+/*
+ * Convert a pressure (Pa) into a standard atmosphere altitude (cm).
+ * The altitude is interpolated from a table of altitudes at the 
+ * pressures 2^n * (1 + j/32), so no floating point math is needed
+ * (see AltitudeTable.h).
+ */
+long Sensors::pressureToAltitude(long pressure)
+{
+    return interpolateAltitude(pressure);
 }
 
-float getAltitude()
+
+/*
+ * Start sampling the analog sensors in the background. Afterwards
+ * getAnalogTemperature() and getAnalogHumidity() return the filtered
+ * values straight away rather than taking readings. Returns false
+ * if the sketch has not expanded ANALOG_SAMPLER_INTERRUPT().
+ */
+bool Sensors::beginAnalogSampling()
 {
-    return 0.0;
+    analogSampler_.addChannel(ANALOG_HUMIDITY);
+    analogSampler_.addChannel(INTERNAL_TEMP);
+    analogSampler_.addChannel(HEATER_TEMP);
+    return analogSampler_.begin();
 }
 
 
@@ -31,119 +90,397 @@ float getAltitude()
  */
 float Sensors::getAnalogTemperature(int pinNumber)
 {
-    unsigned int total = 0;
-    for (int i = 0; i < NUM_READINGS; ++i)
-    {
-        total += analogRead(pinNumber);
-    }
-
-    float reading = (total / NUM_READINGS) * (5000.0 / 1024.0);
-    return (reading - 500.0) / 10.0;
+    return getAnalogTemperatureCenti(pinNumber) / 100.0;
 }
 
 
 float Sensors::getAnalogHumidity(int pinNumber)
 {
+    return getAnalogHumidityCenti(pinNumber) / 100.0;
+}
+
+
+/*
+ * TMP36 temperature in hundredths of a degree C, without any floating
+ * point math. The sensor gives 10 mV per degree with 500 mV at 0 C, so
+ * T = counts * (5000 mV / 1024) / 10 - 50, which in hundredths of a 
+ * degree and sixteenths of a count is exactly (c * 50000) / 2^14 - 5000
+ */
+long Sensors::getAnalogTemperatureCenti(int pinNumber)
+{
+    long counts = getAnalogCounts(pinNumber);
+    return ((counts * TMP36_SCALE) >> TMP36_SHIFT) - TMP36_OFFSET;
+}
+
+
+/*
+ * Relative humidity in hundredths of a percent, without any floating
+ * point math. RH = (counts - 196.2) / 6.3 is evaluated with the slope 
+ * and offset scaled by 2^16 (see HUMIDITY_SCALE), rounding to nearest
+ */
+long Sensors::getAnalogHumidityCenti(int pinNumber)
+{
+    long counts = getAnalogCounts(pinNumber);
+    return (counts * HUMIDITY_SCALE - HUMIDITY_OFFSET + (1L << 15)) >> 16;
+}
+
+
+/*
+ * Average ADC reading of the given pin in sixteenths of a count, from
+ * the background sampler if it samples the pin, otherwise by taking 
+ * readings
+ */
+uint16_t Sensors::getAnalogCounts(int pinNumber)
+{
+    if (analogSampler_.samples(pinNumber)) {
+        return analogSampler_.read(pinNumber);
+    }
+
     unsigned int total = 0;
     for (int i = 0; i < NUM_READINGS; ++i)
     {
         total += analogRead(pinNumber);
     }
-    return ((total / NUM_READINGS) - 196.2) / 6.3;
+
+    return ((unsigned long) total * ANALOG_SCALE) / NUM_READINGS;
 }
 
 
 /*
- * Get the temperature from the digital temperature
- * sensor. Meant to be used with DS18S20 temperature sensor.
- * Returns the temperature from one DS18S20 in DEG Celsius
+ * Get the temperature from the digital temperature sensors. Meant to
+ * be used with DS18S20/DS18B20 temperature sensors. Returns the last
+ * temperature collected by digitalTemperaturePoll() from the given
+ * sensor on the bus in DEG Celsius, or -1000 if there is none.
  */
-float Sensors::getDigitalTemperature(int source)
+float Sensors::getDigitalTemperature(int source, uint8_t sensor)
 {
 
     // This isn't very interesting right now, but if more digital
-    // sensors were added, choosing between them would go here.
+    // buses were added, choosing between them would go here.
+    if (source != EXTERNAL_TEMP)
+    {
+        // Do nothing
+    }
+
+    if (sensor >= numDigitalSensors_ || !digitalValid_[sensor]) {
+        return -1000;
+    }
+
+    return digitalTemps_[sensor] / 16.0;
+}
+
 
-    OneWire ds(externalTemp_);
+/*
+ * The same as getDigitalTemperature(), in hundredths of a degree C.
+ * Returns -100000 if there is no reading.
+ */
+long Sensors::getDigitalTemperatureCenti(int source, uint8_t sensor)
+{
     if (source != EXTERNAL_TEMP)
     {
         // Do nothing
     }
 
-    byte data[12];
+    if (sensor >= numDigitalSensors_ || !digitalValid_[sensor]) {
+        return -100000;
+    }
+
+    // Readings are in sixteenths of a degree: 100/16 = 25/4
+    return ((long) digitalTemps_[sensor] * 25) / 4;
+}
+
+
+uint8_t Sensors::getNumDigitalSensors()
+{
+    return numDigitalSensors_;
+}
+
+
+/*
+ * Search the OneWire bus for temperature sensors and remember their
+ * addresses, so that they never need to be searched for again.
+ * Returns the number of sensors found.
+ */
+uint8_t Sensors::findDigitalSensors()
+{
     byte addr[8];
 
-    if ( !ds.search(addr)) {
-        //no more sensors on chain, reset search
-        ds.reset_search();
-        return -1000;
+    numDigitalSensors_ = 0;
+    externalTemp_.reset_search();
+
+    while (numDigitalSensors_ < MAX_DIGITAL_SENSORS && externalTemp_.search(addr))
+    {
+        if (OneWire::crc8(addr, 7) != addr[7]) {
+            continue;
+        }
+
+        if (addr[0] != DS18S20_FAMILY && addr[0] != DS18B20_FAMILY) {
+            continue;
+        }
+
+        memcpy(digitalAddresses_[numDigitalSensors_], addr, 8);
+        digitalValid_[numDigitalSensors_] = false;
+        ++numDigitalSensors_;
     }
 
-    if ( OneWire::crc8( addr, 7) != addr[7]) {
-        // Serial.println("CRC is not valid!");
-        return -1000;
+    externalTemp_.reset_search();
+    digitalState_ = ONEWIRE_IDLE;
+
+    return numDigitalSensors_;
+}
+
+
+/*
+ * Advance the digital temperature measurements. All of the sensors 
+ * are told to convert at once (Skip ROM), and once the conversion
+ * time has passed their scratchpads are read back, one sensor per 
+ * call so that no call blocks for long. Returns true when a new 
+ * set of temperatures from every sensor has been collected.
+ */
+bool Sensors::digitalTemperaturePoll()
+{
+    if (numDigitalSensors_ == 0) {
+        return false;
     }
 
-    if ( addr[0] != 0x10 && addr[0] != 0x28) {
-        // Serial.print("Device is not recognized");
-        return -1000;
+    if (digitalState_ == ONEWIRE_IDLE)
+    {
+        if (externalTemp_.reset()) {
+            externalTemp_.skip();
+            externalTemp_.write(0x44, 1); // start conversion, with parasite power on at the end
+            digitalState_ = ONEWIRE_CONVERTING;
+            digitalConversionStart_ = millis();
+        }
+        return false;
     }
 
-    ds.reset();
-    ds.select(addr);
-    ds.write(0x44,1); // start conversion, with parasite power on at the end
+    if (digitalState_ == ONEWIRE_CONVERTING)
+    {
+        if (millis() - digitalConversionStart_ < DS18X20_CONVERSION_TIME) {
+            return false;
+        }
+
+        digitalState_ = ONEWIRE_READING;
+        nextDigitalSensor_ = 0;
+    }
+
+    readDigitalSensor(nextDigitalSensor_);
+    ++nextDigitalSensor_;
 
-    byte present = ds.reset();
-    ds.select(addr);  
-    ds.write(0xBE); // Read Scratchpad
+    if (nextDigitalSensor_ < numDigitalSensors_) {
+        return false;
+    }
+
+    digitalState_ = ONEWIRE_IDLE;
+    return true;
+}
 
 
+// Read the scratchpad of one sensor, and store its temperature 
+// (in 1/16 DEG Celsius) if the scratchpad passes its CRC check
+void Sensors::readDigitalSensor(uint8_t sensor)
+{
+    byte data[9];
+    byte* addr = digitalAddresses_[sensor];
+
+    digitalValid_[sensor] = false;
+
+    if (!externalTemp_.reset()) {
+        return;
+    }
+
+    externalTemp_.select(addr);
+    externalTemp_.write(0xBE); // Read Scratchpad
+
     for (int i = 0; i < 9; i++) { // we need 9 bytes
-        data[i] = ds.read();
+        data[i] = externalTemp_.read();
     }
 
-    ds.reset_search();
+    if (OneWire::crc8(data, 8) != data[8]) {
+        return;
+    }
 
-    byte MSB = data[1];
-    byte LSB = data[0];
+    int16_t raw = (data[1] << 8) | data[0]; //using two's compliment
 
-    float tempRead = ((MSB << 8) | LSB); //using two's compliment
-    float TemperatureSum = tempRead / 16;
+    if (addr[0] == DS18S20_FAMILY)
+    {
+        // The DS18S20 reports half degrees, the count remaining
+        // register gives the extra resolution
+        raw = raw << 3;
+        if (data[7] == 0x10) {
+            raw = (raw & 0xFFF0) + 12 - data[6];
+        }
+    }
 
-    return TemperatureSum;
+    digitalTemps_[sensor] = raw;
+    digitalValid_[sensor] = true;
 }
 
 
 // The following functions deal with interfacing with the 
 // BMP_085 sensor
 
-// Stores all of the bmp085's calibration values into global variables
+// Stores all of the bmp085's calibration values into the calibration struct
 // Calibration values are required to calculate temp and pressure
 // This function should be called at the beginning of the program
-void Sensors::bmp085Calibration()
+// The 22 bytes (0xAA - 0xBF) are read in bursts of up to I2C_MAX_READ
+// bytes (one burst of all of them would take longer than I2C_TIMEOUT),
+// most significant byte first for each of the eleven values.
+bool Sensors::bmp085Calibration()
 {
-    ac1 = bmp085ReadInt(0xAA);
-    ac2 = bmp085ReadInt(0xAC);
-    ac3 = bmp085ReadInt(0xAE);
-    ac4 = bmp085ReadInt(0xB0);
-    ac5 = bmp085ReadInt(0xB2);
-    ac6 = bmp085ReadInt(0xB4);
-    b1 = bmp085ReadInt(0xB6);
-    b2 = bmp085ReadInt(0xB8);
-    mb = bmp085ReadInt(0xBA);
-    mc = bmp085ReadInt(0xBC);
-    md = bmp085ReadInt(0xBE);
+    unsigned char data[BMP085_CALIBRATION_LENGTH];
+    for (uint8_t i = 0; i < BMP085_CALIBRATION_LENGTH; i += I2C_MAX_READ)
+    {
+        uint8_t length = BMP085_CALIBRATION_LENGTH - i;
+        if (length > I2C_MAX_READ) {
+            length = I2C_MAX_READ;
+        }
+
+        if (!bmp085ReadBytes(0xAA + i, data + i, length)) {
+            return false;
+        }
+    }
+
+    // The datasheet guarantees no value is 0x0000 or 0xFFFF, which is
+    // what a missing or failing sensor reads as
+    uint16_t values[BMP085_CALIBRATION_LENGTH / 2];
+    for (uint8_t i = 0; i < BMP085_CALIBRATION_LENGTH / 2; ++i) 
+    {
+        values[i] = ((uint16_t) data[2*i] << 8) | data[2*i + 1];
+        if (values[i] == 0x0000 || values[i] == 0xFFFF) {
+            return false;
+        }
+    }
+
+    cal_.ac1 = values[0];
+    cal_.ac2 = values[1];
+    cal_.ac3 = values[2];
+    cal_.ac4 = values[3];
+    cal_.ac5 = values[4];
+    cal_.ac6 = values[5];
+    cal_.b1 = values[6];
+    cal_.b2 = values[7];
+    cal_.mb = values[8];
+    cal_.mc = values[9];
+    cal_.md = values[10];
+
+    calibrated_ = true;
+    return true;
 }
 
-// Calculate temperature given ut.
+// Read the temperature from the BMP085, waiting for the conversion.
 // Value returned will be in units of 0.1 deg C
 short Sensors::bmp085GetTemperature()
 {
-    unsigned int ut = bmp085ReadUT();
+    if (!calibrated_ && !bmp085Calibration()) {
+        return 0;
+    }
+
+    return bmp085CalculateTemperature(bmp085ReadUT());
+}
+
+
+// Read the pressure from the BMP085, waiting for the conversion.
+// b5 is required so bmp085GetTemperature(...) must be called first.
+// Value returned will be pressure in units of Pa.
+long Sensors::bmp085GetPressure()
+{
+    if (!calibrated_ && !bmp085Calibration()) {
+        return 0;
+    }
+
+    return bmp085CalculatePressure(bmp085ReadUP());
+}
+
+
+// Advance the non-blocking BMP085 conversions. Temperature and 
+// pressure conversions alternate; whenever one has had time to finish
+// its result is read and the other conversion is started.
+// Returns true when a new compensated pressure is available.
+bool Sensors::bmp085Poll()
+{
+    // Without the calibration no pressure can be worked out
+    if (!calibrated_) {
+        bmp085Calibration();
+        return false;
+    }
+
+    if (bmp085State_ == BMP085_IDLE)
+    {
+        bmp085StartConversion(BMP085_CONVERTING_TEMPERATURE);
+        return false;
+    }
+
+    unsigned long elapsed = micros() - bmp085ConversionStart_;
+    unsigned char data[3];
+
+    if (bmp085State_ == BMP085_CONVERTING_TEMPERATURE)
+    {
+        if (elapsed < BMP085_TEMPERATURE_TIME) {
+            return false;
+        }
+
+        // If the read fails, start over with a new temperature conversion
+        if (!bmp085ReadBytes(0xF6, data, 2)) {
+            bmp085StartConversion(BMP085_CONVERTING_TEMPERATURE);
+            return false;
+        }
+
+        bmp085Temperature_ = bmp085CalculateTemperature((unsigned int) data[0]<<8 | data[1]);
+        bmp085StartConversion(BMP085_CONVERTING_PRESSURE);
+        return false;
+    }
+
+    // Conversion time depends on the oversampling setting: 
+    // 4.5, 7.5, 13.5 or 25.5 ms
+    if (elapsed < BMP085_PRESSURE_TIME + (BMP085_PRESSURE_STEP << OSS)) {
+        return false;
+    }
+
+    bool success = bmp085ReadBytes(0xF6, data, 3);
+    if (success) {
+        unsigned long up = (((unsigned long) data[0] << 16) | ((unsigned long) data[1] << 8) | (unsigned long) data[2]) >> (8-OSS);
+        bmp085Pressure_ = bmp085CalculatePressure(up);
+    }
+
+    bmp085StartConversion(BMP085_CONVERTING_TEMPERATURE);
+    return success;
+}
+
+
+// Start the given conversion for bmp085Poll(). If the BMP085 could 
+// not be reached the driver goes back to idle, to try again next poll.
+void Sensors::bmp085StartConversion(unsigned char state)
+{
+    bool started = (state == BMP085_CONVERTING_TEMPERATURE) ? bmp085StartUT() : bmp085StartUP();
+
+    bmp085State_ = started ? state : BMP085_IDLE;
+    bmp085ConversionStart_ = micros();
+}
+
+
+// Temperature from the most recent non-blocking conversion (0.1 deg C)
+short Sensors::bmp085Temperature()
+{
+    return bmp085Temperature_;
+}
+
+
+// Pressure from the most recent non-blocking conversion (Pa)
+long Sensors::bmp085Pressure()
+{
+    return bmp085Pressure_;
+}
+
+
+// Calculate temperature given ut.
+// Value returned will be in units of 0.1 deg C
+short Sensors::bmp085CalculateTemperature(unsigned int ut)
+{
     long x1, x2;
 
-    x1 = (((long)ut - (long)ac6)*(long)ac5) >> 15;
-    x2 = ((long)mc << 11)/(x1 + md);
+    x1 = (((long)ut - (long)cal_.ac6)*(long)cal_.ac5) >> 15;
+    x2 = ((long)cal_.mc << 11)/(x1 + cal_.md);
     b5 = x1 + x2;
 
     return ((b5 + 8)>>4);  
@@ -152,26 +489,25 @@ short Sensors::bmp085GetTemperature()
 
 // Calculate pressure given up
 // calibration values must be known
-// b5 is also required so bmp085GetTemperature(...) must be called first.
+// b5 is also required so bmp085CalculateTemperature(...) must be called first.
 // Value returned will be pressure in units of Pa.
-long Sensors::bmp085GetPressure()
+long Sensors::bmp085CalculatePressure(unsigned long up)
 {
-    unsigned long up = bmp085ReadUP();
     long x1, x2, x3, b3, b6, p;
     unsigned long b4, b7;
 
     b6 = b5 - 4000;
     // Calculate B3
-    x1 = (b2 * (b6 * b6)>>12)>>11;
-    x2 = (ac2 * b6)>>11;
+    x1 = (cal_.b2 * (b6 * b6)>>12)>>11;
+    x2 = (cal_.ac2 * b6)>>11;
     x3 = x1 + x2;
-    b3 = (((((long)ac1)*4 + x3)<<OSS) + 2)>>2;
+    b3 = (((((long)cal_.ac1)*4 + x3)<<OSS) + 2)>>2;
 
     // Calculate B4
-    x1 = (ac3 * b6)>>13;
-    x2 = (b1 * ((b6 * b6)>>12))>>16;
+    x1 = (cal_.ac3 * b6)>>13;
+    x2 = (cal_.b1 * ((b6 * b6)>>12))>>16;
     x3 = ((x1 + x2) + 2)>>2;
-    b4 = (ac4 * (unsigned long)(x3 + 32768))>>15;
+    b4 = (cal_.ac4 * (unsigned long)(x3 + 32768))>>15;
 
     b7 = ((unsigned long)(up - b3) * (50000>>OSS));
     if (b7 < 0x80000000)
@@ -189,101 +525,217 @@ long Sensors::bmp085GetPressure()
 
 
 // Read 1 byte from the BMP085 at 'address'
+// Returns 0 if the read failed
 char Sensors::bmp085Read(unsigned char address)
 {
-    unsigned char data;
-
-    Wire.beginTransmission(BMP085_ADDRESS);
-    Wire.write(address);
-    Wire.endTransmission();
-
-    Wire.requestFrom(BMP085_ADDRESS, 1);
-
-    unsigned long startTime = millis();
-    while(!Wire.available())
-    ;
-
-    if (!Wire.available())
-    {
-        return 0;
-    } else {
-        return Wire.read();
-    }
+    unsigned char data = 0;
+    bmp085ReadBytes(address, &data, 1);
+    return data;
 }
 
 // Read 2 bytes from the BMP085
 // First byte will be from 'address'
 // Second byte will be from 'address'+1
+// Returns 0 if the read failed
 int Sensors::bmp085ReadInt(unsigned char address)
 {
-    unsigned char msb, lsb;
-
-    Wire.beginTransmission(BMP085_ADDRESS);
-    Wire.write(address);
-    Wire.endTransmission();
-
-    Wire.requestFrom(BMP085_ADDRESS, 2);
-    unsigned long startTime = millis();
-    while(Wire.available() < 2)
-    ;
-    msb = Wire.read();
-    lsb = Wire.read();
-
-    return (int) msb<<8 | lsb;
+    unsigned char data[2] = {0, 0};
+    bmp085ReadBytes(address, data, 2);
+    return (int) data[0]<<8 | data[1];
 }
 
 
 // Read the uncompensated temperature value
 unsigned int Sensors::bmp085ReadUT()
 {
-    unsigned int ut;
-
-    // Write 0x2E into Register 0xF4
-    // This requests a temperature reading
-    Wire.beginTransmission(BMP085_ADDRESS);
-    Wire.write(0xF4);
-    Wire.write(0x2E);
-    Wire.endTransmission();
+    bmp085StartUT();
 
     // Wait at least 4.5ms
     delay(5);
 
     // Read two bytes from registers 0xF6 and 0xF7
-    ut = bmp085ReadInt(0xF6);
-    return ut;
+    return bmp085ReadInt(0xF6);
 }
 
 
 // Read the uncompensated pressure value
 unsigned long Sensors::bmp085ReadUP()
 {
-    unsigned char msb, lsb, xlsb;
-    unsigned long up = 0;
-
-    // Write 0x34+(OSS<<6) into register 0xF4
-    // Request a pressure reading w/ oversampling setting
-    Wire.beginTransmission(BMP085_ADDRESS);
-    Wire.write(0xF4);
-    Wire.write(0x34 + (OSS<<6));
-    Wire.endTransmission();
+    bmp085StartUP();
 
     // Wait for conversion, delay time dependent on OSS
     delay(2 + (3<<OSS));
 
+    return bmp085ReadRawUP();
+}
+
+
+// Write 0x2E into Register 0xF4
+// This requests a temperature reading
+bool Sensors::bmp085StartUT()
+{
+    return bmp085WriteRegister(0xF4, 0x2E);
+}
+
+
+// Write 0x34+(OSS<<6) into register 0xF4
+// Request a pressure reading w/ oversampling setting
+bool Sensors::bmp085StartUP()
+{
+    return bmp085WriteRegister(0xF4, 0x34 + (OSS<<6));
+}
+
+
+// Read the result of a finished pressure conversion
+// Returns 0 if the read failed
+unsigned long Sensors::bmp085ReadRawUP()
+{
+    unsigned char data[3] = {0, 0, 0};
+
     // Read register 0xF6 (MSB), 0xF7 (LSB), and 0xF8 (XLSB)
+    bmp085ReadBytes(0xF6, data, 3);
+
+    return (((unsigned long) data[0] << 16) | ((unsigned long) data[1] << 8) | (unsigned long) data[2]) >> (8-OSS);
+}
+
+
+// The following functions carry out the I2C transactions with the
+// BMP085. Every transaction gives up after I2C_TIMEOUT, and a failed
+// transaction is counted and followed by a bus recovery.
+
+// Write 'value' into the BMP085 register at 'address'
+bool Sensors::bmp085WriteRegister(unsigned char address, unsigned char value)
+{
+    unsigned long startTime = micros();
+
+    Wire.beginTransmission(BMP085_ADDRESS);
+    Wire.write(address);
+    Wire.write(value);
+    bool success = (Wire.endTransmission() == 0);
+    ++i2cTransactions_;
+
+    return finishTransaction(success, startTime);
+}
+
+
+// Read 'length' consecutive bytes from the BMP085, starting at 'address'
+bool Sensors::bmp085ReadBytes(unsigned char address, unsigned char data[], uint8_t length)
+{
+    unsigned long startTime = micros();
+
     Wire.beginTransmission(BMP085_ADDRESS);
-    Wire.write(0xF6);
-    Wire.endTransmission();
-    Wire.requestFrom(BMP085_ADDRESS, 3);
+    Wire.write(address);
+    bool success = (Wire.endTransmission() == 0);
+    ++i2cTransactions_;
+
+    if (success)
+    {
+        Wire.requestFrom((uint8_t) BMP085_ADDRESS, length);
+        ++i2cTransactions_;
+
+        // Wait for data to become available, but not forever
+        while (Wire.available() < length && micros() - startTime < I2C_TIMEOUT)
+        ;
+        success = (Wire.available() >= length);
+    }
+
+    if (success) {
+        for (uint8_t i = 0; i < length; ++i) {
+            data[i] = Wire.read();
+        }
+    } else {
+        // Throw away whatever part of the reply did arrive
+        while (Wire.available()) {
+            Wire.read();
+        }
+    }
+
+    return finishTransaction(success, startTime);
+}
+
 
-    // Wait for data to become available
-    while(Wire.available() < 3)
-    ;
-    msb = Wire.read();
-    lsb = Wire.read();
-    xlsb = Wire.read();
+// Update the I2C statistics after a transaction, and
+// recover the bus if the transaction failed
+bool Sensors::finishTransaction(bool success, unsigned long startTime)
+{
+    if (!success)
+    {
+        ++i2cErrors_;
+        recoverI2C();
+    }
 
-    up = (((unsigned long) msb << 16) | ((unsigned long) lsb << 8) | (unsigned long) xlsb) >> (8-OSS);
+    unsigned long elapsed = micros() - startTime;
+    if (elapsed > i2cMaxTime_) {
+        i2cMaxTime_ = elapsed;
+    }
 
-    return up;
+    return success;
+}
+
+
+// Release a slave which is holding SDA low by clocking out the rest
+// of its byte, send a stop condition, then restart the Wire library.
+// SCL and SDA are driven open drain: low as outputs, high by pull-up.
+void Sensors::recoverI2C()
+{
+    ++i2cRecoveries_;
+
+    Wire.end();
+    pinMode(SDA, INPUT_PULLUP);
+    pinMode(SCL, INPUT_PULLUP);
+    delayMicroseconds(I2C_HALF_CLOCK);
+
+    for (uint8_t i = 0; i < 9 && !digitalRead(SDA); ++i)
+    {
+        digitalWrite(SCL, LOW);
+        pinMode(SCL, OUTPUT);
+        delayMicroseconds(I2C_HALF_CLOCK);
+        pinMode(SCL, INPUT_PULLUP);
+        delayMicroseconds(I2C_HALF_CLOCK);
+    }
+
+    // Stop condition: SDA rises while SCL is high
+    digitalWrite(SDA, LOW);
+    pinMode(SDA, OUTPUT);
+    delayMicroseconds(I2C_HALF_CLOCK);
+    pinMode(SDA, INPUT_PULLUP);
+    delayMicroseconds(I2C_HALF_CLOCK);
+
+    beginI2C();
+}
+
+
+// Start the Wire library. Where the Wire library supports it, its own
+// waits are also limited to I2C_TIMEOUT, otherwise a bus fault inside
+// endTransmission() or requestFrom() can still stall.
+void Sensors::beginI2C()
+{
+    Wire.begin();
+#if defined(WIRE_HAS_TIMEOUT)
+    Wire.setWireTimeout(I2C_TIMEOUT, true);
+#endif
+}
+
+
+unsigned int Sensors::getI2CErrors()
+{
+    return i2cErrors_;
+}
+
+
+unsigned int Sensors::getI2CRecoveries()
+{
+    return i2cRecoveries_;
+}
+
+
+unsigned long Sensors::getI2CMaxTime()
+{
+    return i2cMaxTime_;
+}
+
+
+unsigned long Sensors::getI2CTransactions()
+{
+    return i2cTransactions_;
 }
@@ -15,6 +15,7 @@
 
 #include "OneWire.h"
 #include "Wire.h"
+#include "AnalogSampler.h"
 
 // These definitions define pin numbers for the 
 // analog sensors
@@ -25,14 +26,86 @@
 // These definitions define the digital sensor pin numbers
 #define EXTERNAL_TEMP 4
 #define BMP085_ADDRESS 0x77
+#define BMP085_CALIBRATION_LENGTH 22
+
+// Attempts begin() makes to read the BMP085 calibration, and the time
+// between them (milliseconds)
+#define BMP085_CALIBRATION_TRIES 5
+#define BMP085_CALIBRATION_RETRY_TIME 10
+
+// Digital temperature sensors which can share the EXTERNAL_TEMP bus
+#define MAX_DIGITAL_SENSORS 8
+#define DS18S20_FAMILY 0x10
+#define DS18B20_FAMILY 0x28
+
+// States of the digital temperature measurements, and the time a
+// conversion takes (milliseconds)
+#define ONEWIRE_IDLE 0
+#define ONEWIRE_CONVERTING 1
+#define ONEWIRE_READING 2
+#define DS18X20_CONVERSION_TIME 750
 
 // Temperature calibration values (in 0.01 degrees C)
 #define ANALOG_INTERIOR_OFFSET 200
 #define HEATER_OFFSET 400
 
+// States of the non-blocking BMP085 conversions
+#define BMP085_IDLE 0
+#define BMP085_CONVERTING_TEMPERATURE 1
+#define BMP085_CONVERTING_PRESSURE 2
+
+// BMP085 conversion times (microseconds). A pressure conversion takes
+// BMP085_PRESSURE_TIME + (BMP085_PRESSURE_STEP << OSS)
+#define BMP085_TEMPERATURE_TIME 4500UL
+#define BMP085_PRESSURE_TIME 1500UL
+#define BMP085_PRESSURE_STEP 3000UL
+
+// Every I2C transaction is abandoned after I2C_TIMEOUT microseconds. A
+// failed transaction is followed by a bus recovery, which clocks SCL at
+// 2 * I2C_HALF_CLOCK microseconds per cycle and takes under 
+// I2C_RECOVERY_TIME. A transaction therefore never takes longer than
+// I2C_TRANSACTION_BUDGET (the write and the read can each time out),
+// and bmp085Poll() never longer than BMP085_POLL_BUDGET.
+// No read is longer than I2C_MAX_READ bytes, so one which works takes
+// about 1.1 ms at 100 kHz (the register write and the read), well 
+// inside I2C_TIMEOUT.
+#define I2C_TIMEOUT 2000UL
+#define I2C_MAX_READ 8
+#define I2C_HALF_CLOCK 5
+#define I2C_RECOVERY_TIME 250UL
+#define I2C_TRANSACTION_BUDGET (2 * I2C_TIMEOUT + I2C_RECOVERY_TIME)
+#define BMP085_POLL_BUDGET (2 * I2C_TRANSACTION_BUDGET)
+
+// Fixed point conversions from sixteenths of an ADC count (5 V reference)
+// TMP36: hundredths of a degree C = ((c * TMP36_SCALE) >> TMP36_SHIFT) - TMP36_OFFSET
+#define TMP36_SCALE 50000L
+#define TMP36_SHIFT 14
+#define TMP36_OFFSET 5000L
+
+// Humidity: hundredths of a percent = (c * HUMIDITY_SCALE - HUMIDITY_OFFSET) >> 16
+// HUMIDITY_SCALE = 2^16 * 100 / (6.3 * 16), HUMIDITY_OFFSET = 196.2 * 16 * HUMIDITY_SCALE
+#define HUMIDITY_SCALE 65016L
+#define HUMIDITY_OFFSET 204098227L
+
 // Number of readings to take from the analog sensors (for averaging) 
 #define NUM_READINGS 5
 
+// Calibration values stored in the BMP085's EEPROM, in register order
+struct BMP085Calibration
+{
+    int16_t ac1;
+    int16_t ac2;
+    int16_t ac3;
+    uint16_t ac4;
+    uint16_t ac5;
+    uint16_t ac6;
+    int16_t b1;
+    int16_t b2;
+    int16_t mb;
+    int16_t mc;
+    int16_t md;
+};
+
 class Sensors
 {
 
@@ -41,18 +114,26 @@ class Sensors
         // OneWire objects for reading from the digital temp sensors
         OneWire externalTemp_;
 
-        // Calibration values for the BMP085 pressure sensor
-        int ac1;
-        int ac2; 
-        int ac3; 
-        unsigned int ac4;
-        unsigned int ac5;
-        unsigned int ac6;
-        int b1; 
-        int b2;
-        int mb;
-        int mc;
-        int md;
+        // Background sampler for the analog sensors
+        AnalogSampler analogSampler_;
+
+        // Addresses of the sensors found on the digital temperature bus,
+        // their latest readings (1/16 deg C), and whether each is valid
+        byte digitalAddresses_[MAX_DIGITAL_SENSORS][8];
+        int16_t digitalTemps_[MAX_DIGITAL_SENSORS];
+        bool digitalValid_[MAX_DIGITAL_SENSORS];
+        uint8_t numDigitalSensors_;
+
+        // State of the digital temperature measurements, the next sensor
+        // to read, and when the current conversion was started
+        uint8_t nextDigitalSensor_;
+        unsigned char digitalState_;
+        unsigned long digitalConversionStart_;
+
+        // Calibration values for the BMP085 pressure sensor, and
+        // whether they have been read successfully
+        BMP085Calibration cal_;
+        bool calibrated_;
 
         // b5 is calculated in bmp085GetTemperature(...), 
         // this variable is also used in bmp085GetPressure(...)
@@ -62,28 +143,98 @@ class Sensors
         // BMP085 oversampling setting
         unsigned char OSS;
 
+        // State of the non-blocking BMP085 conversions, when the current
+        // conversion was started (microseconds), and the latest results
+        unsigned char bmp085State_;
+        unsigned long bmp085ConversionStart_;
+        short bmp085Temperature_;
+        long bmp085Pressure_;
+
+        // Number of failed I2C transactions, number of bus recoveries,
+        // and the longest transaction so far (microseconds)
+        unsigned int i2cErrors_;
+        unsigned int i2cRecoveries_;
+        unsigned long i2cMaxTime_;
+
+        // Number of I2C bus transactions (each write or read) so far
+        unsigned long i2cTransactions_;
+
 
     public:
 
         Sensors();
 
-        void begin();
+        // Returns false if the BMP085 calibration could not be read.
+        // Pressures are not available until it has been, bmp085Poll()
+        // keeps trying to read it.
+        bool begin();
+
+        // Samples ANALOG_HUMIDITY, INTERNAL_TEMP and HEATER_TEMP in the
+        // background from now on (analogRead() must not be used after).
+        // Needs ANALOG_SAMPLER_INTERRUPT() in the sketch.
+        bool beginAnalogSampling();
 
         float getAnalogHumidity(int pinNumber);
 
         float getAnalogTemperature(int pinNumber);
 
-        float getDigitalTemperature(int source);
+        float getDigitalTemperature(int source, uint8_t sensor = 0);
+
+        // Integer versions of the three functions above, in hundredths
+        // of a degree C or hundredths of a percent. These avoid floating
+        // point math altogether.
+        long getAnalogHumidityCenti(int pinNumber);
+
+        long getAnalogTemperatureCenti(int pinNumber);
+
+        long getDigitalTemperatureCenti(int source, uint8_t sensor = 0);
+
+        uint8_t getNumDigitalSensors();
+
+        // Finds and remembers the sensors on the digital temperature bus
+        // (done by begin()), returns the number of sensors found
+        uint8_t findDigitalSensors();
+
+        // Non-blocking digital temperature measurement. Call every loop,
+        // returns true when every sensor has a new reading.
+        bool digitalTemperaturePoll();
 
         short bmp085GetTemperature();
 
         long bmp085GetPressure();
 
-        float getAltitude();
+        // Non-blocking alternative to the two functions above. Call 
+        // bmp085Poll() every loop; it returns true when a new pressure
+        // is ready. Do not mix with the blocking calls.
+        bool bmp085Poll();
+
+        short bmp085Temperature();
+
+        long bmp085Pressure();
+
+        // Altitude (cm) from the BMP085 pressure, and the conversion
+        // from pressure (Pa) used to calculate it
+        long getAltitude();
+
+        long pressureToAltitude(long pressure);
+
+        // I2C health: failed transactions, bus recoveries, and the
+        // longest transaction seen (microseconds)
+        unsigned int getI2CErrors();
+
+        unsigned int getI2CRecoveries();
+
+        unsigned long getI2CMaxTime();
+
+        unsigned long getI2CTransactions();
 
     private:
 
-        void bmp085Calibration();
+        uint16_t getAnalogCounts(int pinNumber);
+
+        void readDigitalSensor(uint8_t sensor);
+
+        bool bmp085Calibration();
 
         char bmp085Read(unsigned char address);
 
@@ -92,6 +243,28 @@ class Sensors
         unsigned int bmp085ReadUT();
 
         unsigned long bmp085ReadUP();
+
+        void bmp085StartConversion(unsigned char state);
+
+        bool bmp085StartUT();
+
+        bool bmp085StartUP();
+
+        unsigned long bmp085ReadRawUP();
+
+        short bmp085CalculateTemperature(unsigned int ut);
+
+        long bmp085CalculatePressure(unsigned long up);
+
+        bool bmp085WriteRegister(unsigned char address, unsigned char value);
+
+        bool bmp085ReadBytes(unsigned char address, unsigned char data[], uint8_t length);
+
+        bool finishTransaction(bool success, unsigned long startTime);
+
+        void recoverI2C();
+
+        void beginI2C();
 };
 
 #endif
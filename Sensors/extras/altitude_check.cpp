@@ -0,0 +1,102 @@
+// Written by Andrew Donelick
+// adonelick@hmc.edu
+
+/*
+ * Checks the altitude table used by Sensors::pressureToAltitude() 
+ * against the exact 1976 U.S. Standard Atmosphere, on a host computer.
+ * Build and run it with:
+ *
+ *     g++ -O2 -o altitude_check altitude_check.cpp && ./altitude_check
+ *
+ * Every pressure from CHECK_MIN_PRESSURE to CHECK_MAX_PRESSURE Pa is 
+ * converted, and the check fails (exit status 1) if any altitude is 
+ * more than CHECK_MAX_ERROR cm from the exact one. It also prints the 
+ * time one conversion takes on the host. On the ATmega the conversion
+ * is the octave search (at most ten steps), two PROGMEM reads and one
+ * 32 bit multiply, with no floating point.
+ */
+
+#include <stdio.h>
+#include <math.h>
+#include <time.h>
+
+#include "../AltitudeTable.h"
+
+#define CHECK_MIN_PRESSURE 130
+#define CHECK_MAX_PRESSURE 110000
+#define CHECK_MAX_ERROR 90
+#define CHECK_REPEATS 100
+
+
+// Layers of the standard atmosphere up to 47 km: base geopotential
+// altitude (m), base temperature (K), lapse rate (K/m), base pressure (Pa)
+struct Layer
+{
+    double altitude;
+    double temperature;
+    double lapseRate;
+    double pressure;
+};
+
+static const Layer layers[] = {
+    {     0.0, 288.15, -0.0065, 101325.0 },
+    { 11000.0, 216.65,  0.0,     22632.06 },
+    { 20000.0, 216.65,  0.001,    5474.889 },
+    { 32000.0, 228.65,  0.0028,    868.0187 }
+};
+
+// g0 M / R* (K/m)
+static const double GMR = 9.80665 * 0.0289644 / 8.3144598;
+
+
+// Exact altitude (m) of a pressure (Pa)
+static double exactAltitude(double pressure)
+{
+    int i = 3;
+    while (i > 0 && pressure > layers[i].pressure) {
+        --i;
+    }
+
+    const Layer& layer = layers[i];
+    if (layer.lapseRate == 0.0) {
+        return layer.altitude - 
+               log(pressure / layer.pressure) * layer.temperature / GMR;
+    }
+
+    return layer.altitude + layer.temperature / layer.lapseRate *
+           (pow(pressure / layer.pressure, -layer.lapseRate / GMR) - 1.0);
+}
+
+
+int main()
+{
+    double worstError = 0.0;
+    long worstPressure = 0;
+
+    for (long pressure = CHECK_MIN_PRESSURE; pressure <= CHECK_MAX_PRESSURE; ++pressure)
+    {
+        double error = fabs(interpolateAltitude(pressure) - 100.0 * exactAltitude(pressure));
+        if (error > worstError) {
+            worstError = error;
+            worstPressure = pressure;
+        }
+    }
+
+    // Time the conversion, keeping the results so it is not optimised out
+    volatile long sink = 0;
+    clock_t start = clock();
+    for (int repeat = 0; repeat < CHECK_REPEATS; ++repeat)
+    {
+        for (long pressure = CHECK_MIN_PRESSURE; pressure <= CHECK_MAX_PRESSURE; ++pressure) {
+            sink = sink + interpolateAltitude(pressure);
+        }
+    }
+    double seconds = (double) (clock() - start) / CLOCKS_PER_SEC;
+    double conversions = (double) CHECK_REPEATS * (CHECK_MAX_PRESSURE - CHECK_MIN_PRESSURE + 1);
+
+    printf("worst error %.1f cm at %ld Pa (limit %d cm)\n", 
+           worstError, worstPressure, CHECK_MAX_ERROR);
+    printf("%.1f ns per conversion on this host\n", 1e9 * seconds / conversions);
+
+    return (worstError <= CHECK_MAX_ERROR) ? 0 : 1;
+}